@@ -0,0 +1,78 @@
+#version 410 core
+
+// Must match `ShapeKind` in main.cpp
+const uint SHAPE_RECT = 0u;
+const uint SHAPE_TRIANGLE = 1u;
+const uint SHAPE_CIRCLE = 2u;
+const uint SHAPE_KIND_MASK = 15u;
+// Translucent pulsing tower range look instead of the flat fill
+const uint SHAPE_RANGE = 16u;
+
+in vec2 v_Local;
+flat in vec2 v_Size;
+flat in vec4 v_Color;
+flat in float v_Outline;
+flat in uint v_Shape;
+
+out vec4 FragColor;
+
+layout (std140) uniform FrameUniforms {
+    float u_Time;
+    float u_AspectRatio;
+};
+
+// Signed distances, negative inside. The box spans [0, w] x [-h, 0] like the instance it came from.
+float sd_rect(vec2 p, vec2 size) {
+    vec2 q = abs(p - vec2(0.5f, -0.5f) * size) - 0.5f * size;
+    return length(max(q, 0.0f)) + min(max(q.x, q.y), 0.0f);
+}
+
+float sd_circle(vec2 p, vec2 size) {
+    float radius = 0.5f * min(size.x, size.y);
+    return length(p - vec2(0.5f, -0.5f) * size) - radius;
+}
+
+// Apex at the top center, base along the bottom edge
+float sd_triangle(vec2 p, vec2 size) {
+    vec2 p0 = vec2(0.5f * size.x, 0.0f);
+    vec2 p1 = vec2(0.0f, -size.y);
+    vec2 p2 = vec2(size.x, -size.y);
+    vec2 e0 = p1 - p0, e1 = p2 - p1, e2 = p0 - p2;
+    vec2 v0 = p - p0, v1 = p - p1, v2 = p - p2;
+    vec2 pq0 = v0 - e0 * clamp(dot(v0, e0) / dot(e0, e0), 0.0f, 1.0f);
+    vec2 pq1 = v1 - e1 * clamp(dot(v1, e1) / dot(e1, e1), 0.0f, 1.0f);
+    vec2 pq2 = v2 - e2 * clamp(dot(v2, e2) / dot(e2, e2), 0.0f, 1.0f);
+    float s = sign(e0.x * e2.y - e0.y * e2.x);
+    vec2 d = min(min(vec2(dot(pq0, pq0), s * (v0.x * e0.y - v0.y * e0.x)),
+                     vec2(dot(pq1, pq1), s * (v1.x * e1.y - v1.y * e1.x))),
+                 vec2(dot(pq2, pq2), s * (v2.x * e2.y - v2.y * e2.x)));
+    return -sqrt(d.x) * sign(d.y);
+}
+
+void main() {
+    uint kind = v_Shape & SHAPE_KIND_MASK;
+    float d;
+    if (kind == SHAPE_TRIANGLE) {
+        d = sd_triangle(v_Local, v_Size);
+    } else if (kind == SHAPE_CIRCLE) {
+        d = sd_circle(v_Local, v_Size);
+    } else {
+        d = sd_rect(v_Local, v_Size);
+    }
+    // An outline is the band of that width centered on the edge, a ring for circles
+    if (v_Outline > 0.0f) d = abs(d) - 0.5f * v_Outline;
+
+    // One pixel wide antialiased edge
+    float coverage = clamp(0.5f - d / fwidth(d), 0.0f, 1.0f);
+    if (coverage <= 0.0f) discard;
+
+    vec4 color = v_Color;
+    if ((v_Shape & SHAPE_RANGE) != 0u) {
+        float time_mult = 1 / 500.0f;
+        color.rgb += 0.15f * sin(u_Time * 2.0f * time_mult);
+        color.a *= 0.8f + 0.2f * sin(u_Time * time_mult);
+    } else {
+        color.rgb = 0.7f * color.rgb + 0.05f * sin(u_Time / 10000.0f);
+    }
+    FragColor = vec4(color.rgb, color.a * coverage);
+}
@@ -0,0 +1,37 @@
+#version 410 core
+
+// Unit quad corner, (0, 0) top left to (1, -1) bottom right
+layout (location = 0) in vec3 aPos;
+// Per instance: top left corner and size of the bounding box, color, outline width and shape
+layout (location = 1) in vec2 aInstancePos;
+layout (location = 2) in vec2 aInstanceSize;
+layout (location = 3) in vec4 aInstanceColor;
+layout (location = 4) in float aInstanceOutline;
+layout (location = 5) in uint aInstanceShape;
+
+// Fragment position relative to the top left corner, in the same units as the size
+out vec2 v_Local;
+flat out vec2 v_Size;
+flat out vec4 v_Color;
+flat out float v_Outline;
+flat out uint v_Shape;
+
+layout (std140) uniform FrameUniforms {
+    float u_Time;
+    float u_AspectRatio;
+};
+
+void main() {
+    // Grown by the outline overhang and two pixels, so the antialiased edge is not cut off by the quad
+    float margin = 0.5f * aInstanceOutline + 4.0f / 720.0f;
+    vec2 corner = aPos.xy;
+    vec2 outward = vec2(2.0f * corner.x - 1.0f, 2.0f * corner.y + 1.0f);
+    v_Local = corner * aInstanceSize + outward * margin;
+    gl_Position = vec4(aInstancePos + v_Local, 0.0f, 1.0f);
+    gl_Position.x = gl_Position.x / u_AspectRatio;
+
+    v_Size = aInstanceSize;
+    v_Color = aInstanceColor;
+    v_Outline = aInstanceOutline;
+    v_Shape = aInstanceShape;
+}
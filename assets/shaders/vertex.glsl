@@ -1,16 +0,0 @@
-#version 410 core
-
-layout (location = 0) in vec3 aPos;
-
-uniform float u_Time;
-
-uniform vec2 u_Pos;
-uniform float u_Width;
-uniform float u_Height;
-
-uniform float u_AspectRatio;
-
-void main() {
-    gl_Position=vec4(u_Pos + vec2(u_Width, u_Height) * aPos.xy, 0.0f,1.0f);
-    gl_Position.x= gl_Position.x/  u_AspectRatio;
-}
\ No newline at end of file
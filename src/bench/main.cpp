@@ -0,0 +1,321 @@
+/* danielsinkin97@gmail.com */
+
+/*
+td_bench: scripted simulation scenarios with machine readable results, to hold performance changes against a
+stored baseline.
+
+    td_bench [--scenario NAME]... [--repetitions N] [--threads N] [--json PATH] [--baseline PATH] [--tolerance F]
+    td_bench --list
+
+Every scenario sets up a fresh simulation, ticks it a few times to warm up and then times a fixed number of
+ticks, `--repetitions` times over (default 3); the fastest repetition counts. Each scenario runs in a forked
+child, so its peak RSS is its own and no scenario inherits the heap of the one before.
+
+--json writes the results as JSON. --baseline compares ns per tick against a file written by --json and fails
+if any scenario got slower by more than the tolerance (default 0.1, so 10%). The baseline in the repository,
+bench/baseline.json, was recorded single threaded on a release build; record one on the machine you compare on.
+*/
+
+#include "sim/sim.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using json = nlohmann::json;
+
+struct Scenario {
+    const char *name;
+    const char *description;
+    long long ticks;
+    std::function<void(Simulation &)> setup;
+    // Runs before every timed tick, for scenarios that keep adding load
+    std::function<void(Simulation &)> before_tick;
+};
+
+// Fixed size so a forked child can hand it back through a pipe as is.
+struct ScenarioResult {
+    long long ticks;
+    double ns_per_tick;
+    double ns_per_entity;
+    double average_entities;
+    long long peak_rss_kb;
+    int enemies_start;
+    int enemies_end;
+    int towers;
+    int projectiles_max;
+};
+
+// Deterministic scatter over the window, returns window normalized coordinates.
+auto scatter_position(uint32_t &state) -> Position {
+    auto next = [&state]() -> float {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+    };
+    float x = next();
+    float y = next();
+    return Position{0.05f + 0.9f * x, 0.05f + 0.9f * y};
+}
+
+auto spawn_scattered_towers(Simulation &sim, int count, int level) -> void {
+    uint32_t rng_state = 0x5eed;
+    for (int i = 0; i < count; ++i) {
+        spawn_tower_at_position(sim, window_normalized_to_ndc(scatter_position(rng_state)));
+        sim.game.towers.back().level = level;
+    }
+}
+
+auto enemy_scaling(const char *name, int enemies, long long ticks) -> Scenario {
+    return Scenario{name, "enemies spread along the path, the three default towers", ticks,
+                    [enemies](Simulation &sim) { spawn_enemies_along_path(sim, enemies, 1000); }, nullptr};
+}
+
+auto tower_scaling(const char *name, int towers, long long ticks) -> Scenario {
+    return Scenario{name, "1k enemies spread along the path, towers scattered over the field", ticks,
+                    [towers](Simulation &sim) {
+                        sim.game.towers.clear();
+                        spawn_scattered_towers(sim, towers, 0);
+                        spawn_enemies_along_path(sim, 1000, 1000);
+                    },
+                    nullptr};
+}
+
+auto scenarios() -> std::vector<Scenario> {
+    std::vector<Scenario> all = {
+        enemy_scaling("enemies_1k", 1000, 2000),
+        enemy_scaling("enemies_10k", 10000, 500),
+        enemy_scaling("enemies_100k", 100000, 50),
+        tower_scaling("towers_10", 10, 2000),
+        tower_scaling("towers_100", 100, 1000),
+        tower_scaling("towers_1000", 1000, 200),
+    };
+    all.push_back(Scenario{
+        "merge_clusters", "50 full size enemies a tick spawned into 10 clusters, merging with what is already there", 600,
+        [](Simulation &) {},
+        [](Simulation &sim) {
+            uint32_t rng_state = static_cast<uint32_t>(sim.tick) * 2654435761u;
+            for (int i = 0; i < 50; ++i) {
+                float cluster = static_cast<float>(i % 10);
+                Position center = window_normalized_to_ndc(Position{0.1f + 0.08f * cluster, 0.5f + 0.03f * (cluster - 5.0f)});
+                Position jitter = scatter_position(rng_state);
+                spawn_enemy_at_position(sim, Position{center.x + 0.04f * (jitter.x - 0.5f), center.y + 0.04f * (jitter.y - 0.5f)});
+            }
+        }});
+    all.push_back(Scenario{
+        "projectile_storm", "1k max level towers along the path firing at 2k enemies that don't die", 600,
+        [](Simulation &sim) {
+            sim.game.towers.clear();
+            for (int i = 0; i < 1000; ++i) {
+                Position on_path = sim.path.position_at(sim.path.length * static_cast<float>(i) / 1000.0f);
+                float side = i % 2 == 0 ? 0.1f : -0.2f;
+                spawn_tower_at_position(sim, Position{on_path.x + side, on_path.y - side});
+                sim.game.towers.back().level = SimConstants::max_tower_level - 1;
+            }
+            spawn_enemies_along_path(sim, 2000, 1 << 30);
+        },
+        nullptr});
+    return all;
+}
+
+auto peak_rss_kb() -> long long {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    // Kilobytes on Linux
+    return usage.ru_maxrss;
+}
+
+auto run_scenario(const Scenario &scenario, int repetitions, ThreadPool *thread_pool) -> ScenarioResult {
+    ScenarioResult result{};
+    result.ticks = scenario.ticks;
+    result.ns_per_tick = std::numeric_limits<double>::infinity();
+    for (int repetition = 0; repetition < repetitions; ++repetition) {
+        Simulation sim;
+        sim.game.enemies.clear();
+        sim.thread_pool = thread_pool;
+        init_simulation(sim);
+        scenario.setup(sim);
+        for (int tick = 0; tick < 10; ++tick) {
+            if (scenario.before_tick) scenario.before_tick(sim);
+            tick_simulation(sim);
+        }
+
+        int enemies_start = sim.game.enemies.size();
+        double entities = 0.0;
+        int projectiles_max = 0;
+        std::chrono::steady_clock::duration elapsed{};
+        for (long long tick = 0; tick < scenario.ticks; ++tick) {
+            if (scenario.before_tick) scenario.before_tick(sim);
+            entities += sim.game.enemies.size() + sim.game.towers.size() + sim.game.projectiles.size();
+            auto start = std::chrono::steady_clock::now();
+            tick_simulation(sim);
+            elapsed += std::chrono::steady_clock::now() - start;
+            projectiles_max = std::max(projectiles_max, sim.game.projectiles.size());
+        }
+
+        double ns_per_tick = std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(scenario.ticks);
+        if (ns_per_tick < result.ns_per_tick) {
+            result.ns_per_tick = ns_per_tick;
+            result.average_entities = entities / static_cast<double>(scenario.ticks);
+            result.ns_per_entity = ns_per_tick / std::max(result.average_entities, 1.0);
+            result.enemies_start = enemies_start;
+            result.enemies_end = sim.game.enemies.size();
+            result.towers = static_cast<int>(sim.game.towers.size());
+            result.projectiles_max = projectiles_max;
+        }
+    }
+    result.peak_rss_kb = peak_rss_kb();
+    return result;
+}
+
+// Runs the scenario in a child process and reads its result back through a pipe.
+auto run_scenario_isolated(const Scenario &scenario, int repetitions, int threads) -> ScenarioResult {
+    int fds[2];
+    if (pipe(fds) != 0) panic("pipe failed");
+    pid_t pid = fork();
+    if (pid < 0) panic("fork failed");
+    if (pid == 0) {
+        close(fds[0]);
+        // The pool's threads only exist in the child, fork only copies the calling thread
+        ThreadPool thread_pool(threads);
+        ScenarioResult result = run_scenario(scenario, repetitions, threads > 1 ? &thread_pool : nullptr);
+        bool ok = write(fds[1], &result, sizeof(result)) == static_cast<ssize_t>(sizeof(result));
+        close(fds[1]);
+        std::exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    close(fds[1]);
+    ScenarioResult result{};
+    ssize_t received = read(fds[0], &result, sizeof(result));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (received != static_cast<ssize_t>(sizeof(result)) || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        std::cerr << "Scenario " << scenario.name << " failed\n";
+        std::exit(EXIT_FAILURE);
+    }
+    return result;
+}
+
+auto result_json(const char *name, const ScenarioResult &result) -> json {
+    return json{{"name", name},
+                {"ticks", result.ticks},
+                {"ns_per_tick", result.ns_per_tick},
+                {"ns_per_entity", result.ns_per_entity},
+                {"average_entities", result.average_entities},
+                {"peak_rss_kb", result.peak_rss_kb},
+                {"enemies_start", result.enemies_start},
+                {"enemies_end", result.enemies_end},
+                {"towers", result.towers},
+                {"projectiles_max", result.projectiles_max}};
+}
+
+// Prints the change against the baseline per scenario, returns false if any got slower than `tolerance` allows.
+auto compare_to_baseline(const json &results, const std::string &path, double tolerance) -> bool {
+    std::ifstream in(path);
+    if (!in) panic("Failed to open the baseline");
+    json baseline;
+    try {
+        baseline = json::parse(in);
+    } catch (const json::exception &e) {
+        std::cerr << "Failed to parse baseline " << path << ": " << e.what() << "\n";
+        return false;
+    }
+
+    bool ok = true;
+    std::cout << "\nagainst " << path << " (tolerance " << tolerance * 100.0 << "%):\n";
+    for (const json &result : results.at("scenarios")) {
+        std::string name = result.at("name");
+        auto base = std::find_if(baseline.at("scenarios").begin(), baseline.at("scenarios").end(),
+                                 [&](const json &entry) { return entry.at("name") == name; });
+        if (base == baseline.at("scenarios").end()) {
+            std::cout << "  " << std::left << std::setw(18) << name << "not in the baseline\n";
+            continue;
+        }
+        double ratio = result.at("ns_per_tick").get<double>() / base->at("ns_per_tick").get<double>();
+        bool regressed = ratio > 1.0 + tolerance;
+        ok &= !regressed;
+        std::cout << "  " << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(2)
+                  << ratio << "x ns/tick, peak RSS " << result.at("peak_rss_kb").get<long long>() << " kB (was "
+                  << base->at("peak_rss_kb").get<long long>() << " kB)" << (regressed ? "  REGRESSION" : "") << "\n";
+    }
+    return ok;
+}
+
+auto main(int argc, char **argv) -> int {
+    std::vector<Scenario> all = scenarios();
+    std::vector<std::string> selected;
+    int repetitions = 3;
+    int threads = 1;
+    std::string json_path;
+    std::string baseline_path;
+    double tolerance = 0.1;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--scenario") == 0 && has_value) {
+            selected.push_back(argv[++i]);
+        } else if (std::strcmp(argv[i], "--repetitions") == 0 && has_value) {
+            repetitions = std::max(std::atoi(argv[++i]), 1);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && has_value) {
+            threads = std::max(std::atoi(argv[++i]), 1);
+        } else if (std::strcmp(argv[i], "--json") == 0 && has_value) {
+            json_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--baseline") == 0 && has_value) {
+            baseline_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--tolerance") == 0 && has_value) {
+            tolerance = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--list") == 0) {
+            for (const Scenario &scenario : all) {
+                std::cout << std::left << std::setw(18) << scenario.name << scenario.description << "\n";
+            }
+            return EXIT_SUCCESS;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--scenario NAME]... [--repetitions N] [--threads N] [--json PATH] [--baseline PATH] [--tolerance F]\n"
+                      << "       " << argv[0] << " --list\n";
+            return EXIT_FAILURE;
+        }
+    }
+    for (const std::string &name : selected) {
+        if (std::none_of(all.begin(), all.end(), [&](const Scenario &scenario) { return name == scenario.name; })) {
+            std::cerr << "Unknown scenario " << name << ", see --list\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    json results{{"version", 1}, {"threads", threads}, {"repetitions", repetitions}, {"scenarios", json::array()}};
+    std::cout << std::left << std::setw(18) << "scenario" << std::right << std::setw(14) << "ns/tick" << std::setw(12)
+              << "ns/entity" << std::setw(10) << "entities" << std::setw(12) << "RSS (MB)" << "\n";
+    for (const Scenario &scenario : all) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), scenario.name) == selected.end()) continue;
+        // Flushed, or the child would print the buffered output again
+        std::cout.flush();
+        ScenarioResult result = run_scenario_isolated(scenario, repetitions, threads);
+        std::cout << std::left << std::setw(18) << scenario.name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << result.ns_per_tick << std::setprecision(2) << std::setw(12) << result.ns_per_entity
+                  << std::setprecision(0) << std::setw(10) << result.average_entities << std::setprecision(1)
+                  << std::setw(12) << static_cast<double>(result.peak_rss_kb) / 1024.0 << "\n";
+        results["scenarios"].push_back(result_json(scenario.name, result));
+    }
+
+    if (!json_path.empty()) {
+        std::ofstream out(json_path);
+        if (!out) panic("Failed to open the JSON output");
+        out << std::setw(2) << results << "\n";
+    }
+    if (!baseline_path.empty() && !compare_to_baseline(results, baseline_path, tolerance)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
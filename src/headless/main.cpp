@@ -0,0 +1,800 @@
+/* danielsinkin97@gmail.com */
+
+/*
+td_headless: ticks the simulation as fast as possible without a window and reports the tick rate.
+
+    td_headless [--ticks N] [--enemies N] [--towers N] [--tick-rate HZ] [--threads N] [--compare-threads] [--flow-field] [--trace PATH]
+    td_headless --check-targets [--ticks N] [--enemies N] [--towers N] [--flow-field]
+    td_headless --check-projectiles
+    td_headless --check-allocations [--ticks N] [--enemies N] [--towers N] [--threads N]
+    td_headless --bench-range-query [--repetitions N] [--enemies N] [--towers N]
+    td_headless --bench-range-kernel [--repetitions N]
+    td_headless --bench-flow-field [--repetitions N]
+    td_headless --bench-snapshot [--repetitions N] [--enemies N] [--towers N] [--snapshot PATH]
+    td_headless --replay PATH [--threads N]
+    td_headless --check-replay [--ticks N] [--enemies N] [--towers N] [--flow-field] [--record PATH]
+
+Extra towers are scattered deterministically over the playfield and extra enemies spread evenly along the
+path, small enough never to merge with each other, on top of the default GameState so the same arguments
+always produce the same workload.
+
+--threads runs the tower phase on a pool of N threads. --compare-threads additionally ticks a single
+threaded copy of the same simulation alongside and fails as soon as the two differ in any enemy or tower;
+without --threads it uses one thread per core, at least 2.
+--flow-field makes enemies follow the flow field around the towers instead of the fixed path.
+--trace turns on the zone profiler and writes the zones of the last ticks as a Chrome trace to PATH.
+
+--check-targets gives the towers every targeting policy in turn and ticks a copy of the simulation alongside
+whose towers rerun the range query every tick. Fails as soon as an incrementally tracked in-range set or
+anything the towers did differs from the copy.
+
+--check-projectiles disables a tower right after it fired and checks that its projectile keeps flying until
+it hits or expires on its expiry tick, once with the target alive and once with the target removed.
+
+--check-allocations ticks a steady workload (1000 enemies spread along the path unless --enemies says
+otherwise, which never merge) and fails if any tick after the warmup allocates from the heap.
+
+--bench-range-query times the tower range query through the spatial grid (including the grid rebuild)
+against the brute force scan over all enemies on the same state, and fails if their results differ.
+
+--bench-range-kernel runs every range kernel variant the CPU supports over 1k to 100k random points, fails
+if any of them disagrees with the scalar kernel (mask, distances or closest point) and reports their timings.
+
+--bench-flow-field fills a 256x256 flow field with 2x2 towers and then keeps removing and placing them,
+timing every incremental repair against a full rebuild and failing if any repair disagrees with it.
+
+--bench-snapshot (100k enemies unless --enemies says otherwise) times encoding the state, writing it to PATH
+and loading it back, fails unless the loaded state is identical and keeps ticking identically to the original, and does
+the same round trip once through the JSON export.
+
+--replay runs a recorded session (`main --record PATH`) as fast as possible and fails at the first tick whose
+state hash differs from the recording. --check-replay plays a scripted session of random inputs, records it
+to PATH, replays it from the file, and checks that a replay with one input moved diverges on that input's tick.
+*/
+
+#include "sim/alloc_counter.hpp"
+#include "sim/profiler.hpp"
+#include "sim/replay.hpp"
+#include "sim/sim.hpp"
+#include "sim/snapshot.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+
+struct HeadlessArgs {
+    long long ticks = 100000;
+    int enemies = 0;
+    int towers = 0;
+    int tick_rate = SimConstants::default_tick_rate;
+    bool bench_range_query = false;
+    bool bench_range_kernel = false;
+    bool bench_flow_field = false;
+    bool bench_snapshot = false;
+    std::string snapshot_path = "td_snapshot.bin";
+    std::string replay_path;
+    bool check_replay = false;
+    std::string record_path = "td_replay.bin";
+    std::string trace_path;
+    bool flow_field = false;
+    // 0 unless given: one thread, or every core for --compare-threads
+    int threads = 0;
+    bool compare_threads = false;
+    bool check_targets = false;
+    bool check_projectiles = false;
+    bool check_allocations = false;
+    int repetitions = 100;
+};
+
+auto parse_args(int argc, char **argv) -> HeadlessArgs {
+    HeadlessArgs args;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--ticks") == 0 && has_value) {
+            args.ticks = std::atoll(argv[++i]);
+        } else if (std::strcmp(argv[i], "--enemies") == 0 && has_value) {
+            args.enemies = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--towers") == 0 && has_value) {
+            args.towers = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--tick-rate") == 0 && has_value) {
+            args.tick_rate = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && has_value) {
+            args.threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--compare-threads") == 0) {
+            args.compare_threads = true;
+        } else if (std::strcmp(argv[i], "--check-targets") == 0) {
+            args.check_targets = true;
+        } else if (std::strcmp(argv[i], "--check-projectiles") == 0) {
+            args.check_projectiles = true;
+        } else if (std::strcmp(argv[i], "--check-allocations") == 0) {
+            args.check_allocations = true;
+        } else if (std::strcmp(argv[i], "--bench-range-query") == 0) {
+            args.bench_range_query = true;
+        } else if (std::strcmp(argv[i], "--bench-range-kernel") == 0) {
+            args.bench_range_kernel = true;
+        } else if (std::strcmp(argv[i], "--bench-flow-field") == 0) {
+            args.bench_flow_field = true;
+        } else if (std::strcmp(argv[i], "--bench-snapshot") == 0) {
+            args.bench_snapshot = true;
+        } else if (std::strcmp(argv[i], "--snapshot") == 0 && has_value) {
+            args.snapshot_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--replay") == 0 && has_value) {
+            args.replay_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--check-replay") == 0) {
+            args.check_replay = true;
+        } else if (std::strcmp(argv[i], "--record") == 0 && has_value) {
+            args.record_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--trace") == 0 && has_value) {
+            args.trace_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--flow-field") == 0) {
+            args.flow_field = true;
+        } else if (std::strcmp(argv[i], "--repetitions") == 0 && has_value) {
+            args.repetitions = std::atoi(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--ticks N] [--enemies N] [--towers N] [--tick-rate HZ] [--threads N] [--compare-threads] [--flow-field] [--trace PATH]\n"
+                      << "       " << argv[0] << " --check-targets [--ticks N] [--enemies N] [--towers N] [--flow-field]\n"
+                      << "       " << argv[0] << " --check-projectiles\n"
+                      << "       " << argv[0] << " --check-allocations [--ticks N] [--enemies N] [--towers N] [--threads N]\n"
+                      << "       " << argv[0] << " --bench-range-query [--repetitions N] [--enemies N] [--towers N]\n"
+                      << "       " << argv[0] << " --bench-range-kernel [--repetitions N]\n"
+                      << "       " << argv[0] << " --bench-flow-field [--repetitions N]\n"
+                      << "       " << argv[0] << " --bench-snapshot [--repetitions N] [--enemies N] [--towers N] [--snapshot PATH]\n"
+                      << "       " << argv[0] << " --replay PATH [--threads N]\n"
+                      << "       " << argv[0] << " --check-replay [--ticks N] [--enemies N] [--towers N] [--flow-field] [--record PATH]\n";
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    return args;
+}
+
+// Deterministic scatter over the window, returns window normalized coordinates.
+auto scatter_position(uint32_t &state) -> Position {
+    auto next = [&state]() -> float {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+    };
+    float x = next();
+    float y = next();
+    return Position{0.05f + 0.9f * x, 0.05f + 0.9f * y};
+}
+
+auto same_enemies_in_range(std::vector<EnemyInRange> a, std::vector<EnemyInRange> b) -> bool {
+    auto by_id = [](const EnemyInRange &l, const EnemyInRange &r) { return l.id < r.id; };
+    std::sort(a.begin(), a.end(), by_id);
+    std::sort(b.begin(), b.end(), by_id);
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].id != b[i].id || a[i].distance != b[i].distance) return false;
+    }
+    return true;
+}
+
+auto run_range_query_benchmark(Simulation &sim, int repetitions) -> int {
+    std::vector<EnemyInRange> brute_result;
+    std::vector<EnemyInRange> grid_result;
+    size_t total_in_range = 0;
+
+    auto range_of = [&](const Tower &tower) { return sim.table_tower_range[tower.level]; };
+    for (auto &tower : sim.game.towers) {
+        sim.enemy_grid.rebuild(sim.game.enemies);
+        collect_enemies_in_radius_brute_force(sim, tower.box.get_center(), range_of(tower), brute_result);
+        collect_enemies_in_radius(sim, tower.box.get_center(), range_of(tower), grid_result);
+        if (!same_enemies_in_range(brute_result, grid_result)) {
+            std::cerr << "Range query mismatch for tower " << tower.id << ": brute force found "
+                      << brute_result.size() << ", grid found " << grid_result.size() << "\n";
+            return EXIT_FAILURE;
+        }
+        total_in_range += brute_result.size();
+    }
+
+    auto time_it = [&](auto &&body) -> double {
+        auto start = std::chrono::steady_clock::now();
+        for (int rep = 0; rep < repetitions; ++rep) {
+            body();
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / repetitions;
+    };
+    double brute_ns = time_it([&]() {
+        for (auto &tower : sim.game.towers) {
+            collect_enemies_in_radius_brute_force(sim, tower.box.get_center(), range_of(tower), brute_result);
+        }
+    });
+    double grid_ns = time_it([&]() {
+        sim.enemy_grid.rebuild(sim.game.enemies);
+        for (auto &tower : sim.game.towers) {
+            collect_enemies_in_radius(sim, tower.box.get_center(), range_of(tower), grid_result);
+        }
+    });
+
+    std::cout << "enemies: " << sim.game.enemies.size() << "\n"
+              << "towers: " << sim.game.towers.size() << "\n"
+              << "enemies in range (sum over towers): " << total_in_range << "\n"
+              << "brute force (ns per tick): " << brute_ns << "\n"
+              << "grid incl. rebuild (ns per tick): " << grid_ns << "\n"
+              << "speedup: " << brute_ns / grid_ns << "x\n";
+    return EXIT_SUCCESS;
+}
+
+// Result of running one kernel over a whole point array in blocks, as the grid would.
+struct KernelScan {
+    std::vector<uint64_t> masks;
+    std::vector<float> distances;
+    int closest = -1;
+};
+
+auto scan_with_kernel(RangeKernel kernel, const std::vector<float> &xs, const std::vector<float> &ys,
+                      Position center, float radius, KernelScan &scan) -> void {
+    int count = static_cast<int>(xs.size());
+    scan.masks.resize((count + range_kernel_block_size - 1) / range_kernel_block_size);
+    scan.distances.resize(count);
+    scan.closest = -1;
+    float closest_distance = 0.0f;
+    for (int start = 0, block_idx = 0; start < count; start += range_kernel_block_size, ++block_idx) {
+        int n = std::min(count - start, range_kernel_block_size);
+        RangeBlock block = kernel(&xs[start], &ys[start], n, center, radius, &scan.distances[start]);
+        scan.masks[block_idx] = block.mask;
+        if (block.closest != -1 && (scan.closest == -1 || block.closest_distance < closest_distance)) {
+            scan.closest = start + block.closest;
+            closest_distance = block.closest_distance;
+        }
+    }
+}
+
+auto run_range_kernel_benchmark(int repetitions) -> int {
+    uint32_t rng_state = 0x5eed;
+    const Position center = window_normalized_to_ndc(Position{0.5f, 0.5f});
+    const float radius = 0.45f;
+
+    std::cout << "kernels:";
+    for (int i = 0; i < static_cast<int>(RangeKernelIsa::NumRangeKernelIsa); ++i) {
+        auto isa = static_cast<RangeKernelIsa>(i);
+        if (range_kernel_isa_supported(isa)) std::cout << " " << range_kernel_isa_name(isa);
+    }
+    std::cout << " (default " << range_kernel_isa_name(best_range_kernel_isa()) << ")\n";
+
+    for (int count : {1000, 10000, 100000}) {
+        std::vector<float> xs(count);
+        std::vector<float> ys(count);
+        for (int i = 0; i < count; ++i) {
+            Position p = window_normalized_to_ndc(scatter_position(rng_state));
+            xs[i] = p.x;
+            ys[i] = p.y;
+        }
+        // A few exact duplicates so the tie-breaking gets exercised
+        for (int i = 0; i + 97 < count; i += 97) {
+            xs[i + 97] = xs[i];
+            ys[i + 97] = ys[i];
+        }
+
+        KernelScan reference;
+        scan_with_kernel(range_kernel_scalar, xs, ys, center, radius, reference);
+        KernelScan scan;
+        for (int i = 0; i < static_cast<int>(RangeKernelIsa::NumRangeKernelIsa); ++i) {
+            auto isa = static_cast<RangeKernelIsa>(i);
+            if (!range_kernel_isa_supported(isa)) continue;
+            RangeKernel kernel = range_kernel(isa);
+
+            scan_with_kernel(kernel, xs, ys, center, radius, scan);
+            bool same = scan.masks == reference.masks && scan.closest == reference.closest &&
+                        std::memcmp(scan.distances.data(), reference.distances.data(), count * sizeof(float)) == 0;
+            if (!same) {
+                std::cerr << "Range kernel " << range_kernel_isa_name(isa) << " disagrees with scalar on " << count << " points\n";
+                return EXIT_FAILURE;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            for (int rep = 0; rep < repetitions; ++rep) {
+                scan_with_kernel(kernel, xs, ys, center, radius, scan);
+            }
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / repetitions;
+            std::cout << count << " points, " << range_kernel_isa_name(isa) << ": " << ns << " ns ("
+                      << ns / count << " ns per point)\n";
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+// Latency summary of one kind of repair, in microseconds.
+auto print_latencies(const char *name, std::vector<double> &us) -> void {
+    std::sort(us.begin(), us.end());
+    double sum = 0.0;
+    for (double v : us) {
+        sum += v;
+    }
+    auto at = [&](double q) { return us[static_cast<size_t>(q * (us.size() - 1))]; };
+    std::cout << name << " (us): mean " << sum / us.size() << ", p50 " << at(0.5) << ", p99 " << at(0.99)
+              << ", max " << us.back() << "\n";
+}
+
+auto run_flow_field_benchmark(int repetitions) -> int {
+    constexpr int size = 256;
+    constexpr int towers = 4096;
+    FlowField field(size, size, 0.0f, 0.0f, 1.0f);
+    // Exit along the right edge
+    field.add_goal(Box{Position{size - 1.0f, static_cast<float>(size)}, 1.0f, static_cast<float>(size)});
+    field.rebuild();
+    FlowField reference = field;
+
+    uint32_t rng_state = 0x5eed;
+    auto random_tower = [&]() -> Box {
+        rng_state = rng_state * 1664525u + 1013904223u;
+        int x = static_cast<int>((rng_state >> 8) % (size - 2));
+        rng_state = rng_state * 1664525u + 1013904223u;
+        int y = static_cast<int>((rng_state >> 8) % (size - 1)) + 2;
+        return Box{Position{static_cast<float>(x), static_cast<float>(y)}, 2.0f, 2.0f};
+    };
+
+    std::vector<Box> placed;
+    std::vector<double> place_us;
+    std::vector<double> remove_us;
+    long long changed_cells = 0;
+    auto timed = [&](auto &&body) -> double {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    };
+    auto check = [&](const char *what, int op) -> bool {
+        changed_cells += field.last_repair_cells;
+        reference.blockers = field.blockers;
+        reference.rebuild();
+        if (reference.distance == field.distance) return true;
+        std::cerr << "Flow field repair after " << what << " " << op << " differs from a full rebuild\n";
+        return false;
+    };
+
+    // Fill up, then churn: every op removes a random tower and places a new one
+    for (int op = 0; op < towers; ++op) {
+        Box tower = random_tower();
+        place_us.push_back(timed([&]() { field.add_blocker(tower); }));
+        placed.push_back(tower);
+        if (!check("placing tower", op)) return EXIT_FAILURE;
+    }
+    for (int op = 0; op < towers; ++op) {
+        rng_state = rng_state * 1664525u + 1013904223u;
+        size_t victim = (rng_state >> 8) % placed.size();
+        remove_us.push_back(timed([&]() { field.remove_blocker(placed[victim]); }));
+        if (!check("removing tower", op)) return EXIT_FAILURE;
+
+        placed[victim] = random_tower();
+        place_us.push_back(timed([&]() { field.add_blocker(placed[victim]); }));
+        if (!check("placing tower", towers + op)) return EXIT_FAILURE;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int rep = 0; rep < repetitions; ++rep) {
+        reference.rebuild();
+    }
+    double rebuild_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / repetitions;
+
+    int blocked = 0;
+    int walled_off = 0;
+    for (int cell = 0; cell < field.cell_count(); ++cell) {
+        blocked += field.is_blocked(cell);
+        walled_off += !field.is_blocked(cell) && field.distance[cell] == FlowField::unreachable;
+    }
+    std::cout << "grid: " << size << "x" << size << ", towers: " << placed.size() << " (2x2)\n"
+              << "blocked cells: " << blocked << ", walled off cells: " << walled_off << "\n"
+              << "repairs: " << place_us.size() + remove_us.size() << ", all identical to a full rebuild\n"
+              << "changed cells per repair: " << static_cast<double>(changed_cells) / (place_us.size() + remove_us.size()) << "\n";
+    print_latencies("place repair", place_us);
+    print_latencies("remove repair", remove_us);
+    std::cout << "full rebuild (us): " << rebuild_us << "\n";
+    return EXIT_SUCCESS;
+}
+
+// Exact comparison of everything a tick writes.
+auto same_simulation_state(const Simulation &a, const Simulation &b) -> bool {
+    const EnemyStore &ea = a.game.enemies;
+    const EnemyStore &eb = b.game.enemies;
+    bool same = a.tick == b.tick && a.game.life == b.game.life && a.game.score == b.game.score &&
+                ea.x == eb.x && ea.y == eb.y && ea.w == eb.w && ea.h == eb.h && ea.hp == eb.hp &&
+                ea.hp_max == eb.hp_max && ea.progress == eb.progress && ea.id == eb.id &&
+                a.game.towers.size() == b.game.towers.size();
+    for (size_t tower_idx = 0; same && tower_idx < a.game.towers.size(); ++tower_idx) {
+        const Tower &ta = a.game.towers[tower_idx];
+        const Tower &tb = b.game.towers[tower_idx];
+        same = ta.tick_of_last_shot == tb.tick_of_last_shot;
+    }
+    const ProjectileStore &pa = a.game.projectiles;
+    const ProjectileStore &pb = b.game.projectiles;
+    return same && pa.x == pb.x && pa.y == pb.y && pa.dir_x == pb.dir_x && pa.dir_y == pb.dir_y &&
+           pa.damage == pb.damage && pa.tower_idx == pb.tower_idx && pa.expire_tick == pb.expire_tick;
+}
+
+/*
+One tower, one enemy walking past it. Once the tower fired it gets disabled, and from then on the projectile
+has to keep moving by exactly one step per tick until it either hits the enemy or expires at its expiry tick,
+while the tower fires nothing anymore. With `kill_target` the enemy is removed right after the shot, so the
+projectile has to fly until it expires.
+*/
+auto check_projectile_outlives_tower(bool kill_target) -> bool {
+    Simulation sim;
+    sim.game.enemies.clear();
+    sim.game.towers.clear();
+    // Starts with no room at all, so the first shot has to grow the pool
+    sim.projectile_capacity = 0;
+    spawn_tower_at_position(sim, window_normalized_to_ndc(Position{0.16f, 0.80f}));
+    spawn_enemy_at_position(sim, sim.path_markers.front().position);
+    init_simulation(sim);
+
+    ProjectileStore &projectiles = sim.game.projectiles;
+    while (projectiles.empty()) {
+        if (sim.tick > sim.seconds_to_ticks(60.0f)) {
+            std::cerr << "The tower never fired\n";
+            return false;
+        }
+        tick_simulation(sim);
+    }
+    long long fired_tick = sim.tick - 1;
+    Position tower_center = sim.game.towers[0].box.get_center();
+    apply_input(sim, InputCommand{InputType::DisableTowerAt, tower_center});
+    if (kill_target) {
+        kill_enemy(sim, 0);
+        sim.game.enemies.compact();
+    }
+
+    float step = SimConstants::projectile_speed * sim.dt();
+    float expected_x = projectiles.x[0];
+    float expected_y = projectiles.y[0];
+    while (true) {
+        int hp_before = sim.game.enemies.empty() ? 0 : sim.game.enemies.hp[0];
+        int damage = projectiles.damage[0];
+        long long expire_tick = projectiles.expire_tick[0];
+        expected_x += step * projectiles.dir_x[0];
+        expected_y += step * projectiles.dir_y[0];
+        long long tick = sim.tick;
+        tick_simulation(sim);
+
+        if (projectiles.size() > 1) {
+            std::cerr << "The disabled tower fired again at tick " << tick << "\n";
+            return false;
+        }
+        if (projectiles.size() == 1) {
+            if (projectiles.x[0] != expected_x || projectiles.y[0] != expected_y || tick >= expire_tick) {
+                std::cerr << "Projectile off course or alive past its expiry at tick " << tick << "\n";
+                return false;
+            }
+            continue;
+        }
+        bool expired = tick == expire_tick;
+        bool hit = !kill_target && (sim.game.enemies.empty() || sim.game.enemies.hp[0] == hp_before - damage);
+        if (!expired && !hit) {
+            std::cerr << "Projectile vanished at tick " << tick << " without hitting or expiring\n";
+            return false;
+        }
+        std::cout << "projectile fired at tick " << fired_tick << (hit ? " hit" : " expired") << " at tick " << tick
+                  << " after its tower was disabled (pool grew " << projectiles.grows << " times)\n";
+        return true;
+    }
+}
+
+/*
+Enemies spread along the path, small enough never to touch, and towers firing at them: a workload that stays
+the same from tick to tick. Once the warmup ticks grew every buffer to its size, no tick may allocate.
+*/
+auto check_steady_state_allocations(int enemy_count, int tower_count, int threads, long long ticks) -> bool {
+    Simulation sim;
+    sim.game.enemies.clear();
+    uint32_t rng_state = 0x5eed;
+    for (int i = 0; i < tower_count; ++i) {
+        spawn_tower_at_position(sim, window_normalized_to_ndc(scatter_position(rng_state)));
+    }
+    spawn_enemies_along_path(sim, enemy_count, SimConstants::enemy_hp);
+    init_simulation(sim);
+    ThreadPool thread_pool(threads);
+    if (threads > 1) sim.thread_pool = &thread_pool;
+
+    constexpr int warmup_ticks = 200;
+    for (int tick = 0; tick < warmup_ticks; ++tick) {
+        tick_simulation(sim);
+    }
+    AllocationCounts before = allocation_counts();
+    for (long long tick = 0; tick < ticks; ++tick) {
+        AllocationCounts tick_before = allocation_counts();
+        tick_simulation(sim);
+        AllocationCounts allocated = allocation_counts() - tick_before;
+        if (allocated.allocations != 0) {
+            std::cerr << "Tick " << sim.tick - 1 << " allocated " << allocated.allocations << " times (" << allocated.bytes
+                      << " bytes) with " << sim.game.enemies.size() << " enemies and " << sim.game.projectiles.size() << " projectiles\n";
+            return false;
+        }
+    }
+    AllocationCounts total = allocation_counts() - before;
+    std::cout << "no heap allocations in " << ticks << " ticks after " << warmup_ticks << " warmup ticks (" << total.frees
+              << " frees) with " << threads << " threads, " << sim.game.enemies.size() << " enemies left, "
+              << sim.game.projectiles.grows << " projectile pool grows\n";
+    return total.frees == 0;
+}
+
+auto same_in_range_sets(const Simulation &a, const Simulation &b) -> bool {
+    for (size_t tower_idx = 0; tower_idx < a.game.towers.size(); ++tower_idx) {
+        if (!same_enemies_in_range(a.game.towers[tower_idx].targets.in_range, b.game.towers[tower_idx].targets.in_range)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+auto run_target_check(Simulation &sim, long long ticks) -> int {
+    for (size_t tower_idx = 0; tower_idx < sim.game.towers.size(); ++tower_idx) {
+        int policy = static_cast<int>(tower_idx) % static_cast<int>(TargetingPolicy::NumTargetingPolicy);
+        sim.game.towers[tower_idx].targeting = static_cast<TargetingPolicy>(policy);
+    }
+    Simulation reference = sim;
+    for (long long tick = 0; tick < ticks; ++tick) {
+        tick_simulation(sim);
+        reference.target_drift = std::numeric_limits<float>::infinity();
+        tick_simulation(reference);
+        if (!same_simulation_state(sim, reference) || !same_in_range_sets(sim, reference)) {
+            std::cerr << "Incremental targeting diverged from a full range query at tick " << tick << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    std::cout << "identical to a range query every tick for " << ticks << " ticks (" << sim.target_refreshes
+              << " refreshes instead of " << reference.target_refreshes << ")\n";
+    return EXIT_SUCCESS;
+}
+
+// Everything a snapshot restores, on top of what `same_simulation_state` compares.
+auto same_snapshot_state(const Simulation &a, const Simulation &b) -> bool {
+    const EnemyStore &ea = a.game.enemies;
+    const EnemyStore &eb = b.game.enemies;
+    const ProjectileStore &pa = a.game.projectiles;
+    const ProjectileStore &pb = b.game.projectiles;
+    bool same = same_simulation_state(a, b) && ea.prev_x == eb.prev_x &&
+                ea.prev_y == eb.prev_y && ea.alive == eb.alive && ea.slot_of_index == eb.slot_of_index &&
+                ea.generation == eb.generation && ea.free_indices == eb.free_indices && pa.prev_x == pb.prev_x &&
+                pa.prev_y == pb.prev_y && pa.alive == pb.alive;
+    for (size_t tower_idx = 0; same && tower_idx < a.game.towers.size(); ++tower_idx) {
+        const Tower &ta = a.game.towers[tower_idx];
+        const Tower &tb = b.game.towers[tower_idx];
+        same = ta.id == tb.id && ta.is_active == tb.is_active && ta.type == tb.type && ta.level == tb.level &&
+               ta.targeting == tb.targeting && ta.box.position.x == tb.box.position.x &&
+               ta.box.position.y == tb.box.position.y && ta.box.width == tb.box.width &&
+               ta.box.height == tb.box.height;
+    }
+    return same;
+}
+
+// Ticks both simulations side by side, false as soon as they differ.
+auto tick_identically(Simulation &a, Simulation &b, long long ticks) -> bool {
+    for (long long tick = 0; tick < ticks; ++tick) {
+        tick_simulation(a);
+        tick_simulation(b);
+        if (!same_simulation_state(a, b)) return false;
+    }
+    return true;
+}
+
+auto run_snapshot_benchmark(Simulation &sim, const std::string &path, int repetitions) -> int {
+    // Not ticked first, the merge would fold the scattered enemies into a few. Some dead ones instead, so
+    // there are freed enemy handles to restore.
+    for (int slot = sim.game.enemies.size() - 1; slot >= 0; slot -= 10) {
+        kill_enemy(sim, slot);
+    }
+    sim.game.enemies.compact();
+    sim.game.towers[0].targeting = TargetingPolicy::Strongest;
+
+    std::vector<std::byte> buffer;
+    Simulation restored;
+    std::vector<double> encode_us;
+    std::vector<double> write_us;
+    std::vector<double> load_us;
+    for (int repetition = 0; repetition < repetitions; ++repetition) {
+        auto start = std::chrono::steady_clock::now();
+        encode_snapshot(sim, buffer);
+        auto encoded = std::chrono::steady_clock::now();
+        if (!write_snapshot_file(path, buffer)) return EXIT_FAILURE;
+        auto written = std::chrono::steady_clock::now();
+        if (!load_snapshot(restored, path)) return EXIT_FAILURE;
+        auto loaded = std::chrono::steady_clock::now();
+        encode_us.push_back(std::chrono::duration<double, std::micro>(encoded - start).count());
+        write_us.push_back(std::chrono::duration<double, std::micro>(written - encoded).count());
+        load_us.push_back(std::chrono::duration<double, std::micro>(loaded - written).count());
+    }
+    std::cout << "snapshot of " << sim.game.enemies.size() << " enemies, " << sim.game.towers.size() << " towers, "
+              << sim.game.projectiles.size() << " projectiles: " << buffer.size() << " bytes\n";
+    // The encode is what the simulation waits for, the game writes the file on another thread
+    print_latencies("encode", encode_us);
+    print_latencies("write", write_us);
+    print_latencies("load", load_us);
+    if (!same_snapshot_state(sim, restored) || !tick_identically(sim, restored, 100)) {
+        std::cerr << "Binary snapshot round trip changed the simulation\n";
+        return EXIT_FAILURE;
+    }
+
+    std::string json_path = path + ".json";
+    Simulation from_json;
+    auto start = std::chrono::steady_clock::now();
+    if (!export_snapshot_json(sim, json_path) || !import_snapshot_json(from_json, json_path)) return EXIT_FAILURE;
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    std::cout << "json round trip (ms): " << elapsed.count() << "\n";
+    if (!same_snapshot_state(sim, from_json) || !tick_identically(sim, from_json, 100)) {
+        std::cerr << "JSON snapshot round trip changed the simulation\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "both round trips identical and tick identically afterwards\n";
+    return EXIT_SUCCESS;
+}
+
+auto run_replay_file(const std::string &path, int threads) -> int {
+    Replay replay;
+    if (!load_replay(replay, path)) return EXIT_FAILURE;
+    Simulation sim;
+    if (!begin_replay(sim, replay)) return EXIT_FAILURE;
+    ThreadPool thread_pool(threads);
+    if (threads > 1) sim.thread_pool = &thread_pool;
+
+    auto start = std::chrono::steady_clock::now();
+    ReplayResult result = run_replay(sim, replay);
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    if (result.diverged_tick != -1) {
+        std::cerr << "Replay diverged from the recording at tick " << result.diverged_tick << "\n";
+        return EXIT_FAILURE;
+    }
+    double simulated = static_cast<double>(result.ticks) / replay.tick_rate;
+    std::cout << "replayed " << result.ticks << " ticks (" << simulated << " s of play, " << replay.inputs.size()
+              << " inputs) in " << elapsed.count() << " s, " << simulated / elapsed.count() << "x real time\n"
+              << "score: " << sim.game.score << ", life: " << sim.game.life << "\n";
+    return EXIT_SUCCESS;
+}
+
+// Plays `ticks` ticks of random player input on `sim`, recording them into `replay`.
+auto record_scripted_session(Simulation &sim, Replay &replay, long long ticks) -> void {
+    uint32_t rng_state = 0xc0ffee;
+    auto roll = [&rng_state](uint32_t one_in) {
+        rng_state = rng_state * 1664525u + 1013904223u;
+        return (rng_state >> 8) % one_in == 0;
+    };
+    auto apply = [&](InputType type, Position position) {
+        InputCommand input{type, position};
+        record_input(sim, replay, input);
+        apply_input(sim, input);
+    };
+
+    start_recording(sim, replay);
+    for (long long tick = 0; tick < ticks; ++tick) {
+        if (roll(20)) apply(InputType::SpawnEnemy, sim.path_markers.front().position);
+        if (roll(600)) apply(InputType::SpawnTower, window_normalized_to_ndc(scatter_position(rng_state)));
+        if (!sim.game.towers.empty() && roll(400)) {
+            const Tower &tower = sim.game.towers[rng_state % sim.game.towers.size()];
+            apply(roll(2) ? InputType::CycleTargetingAt : InputType::DisableTowerAt, tower.box.get_center());
+        }
+        tick_simulation(sim);
+        record_tick(sim, replay);
+    }
+}
+
+auto run_replay_check(Simulation &sim, long long ticks, const std::string &path) -> int {
+    Replay recorded;
+    record_scripted_session(sim, recorded, ticks);
+    if (!save_replay(recorded, path)) return EXIT_FAILURE;
+
+    Replay replay;
+    Simulation replayed;
+    if (!load_replay(replay, path) || !begin_replay(replayed, replay)) return EXIT_FAILURE;
+    ReplayResult result = run_replay(replayed, replay);
+    if (result.diverged_tick != -1 || !same_snapshot_state(sim, replayed)) {
+        std::cerr << "Replay of the recorded session diverged at tick " << result.diverged_tick << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // Moving one placed tower has to show up in the hash of the very tick it was placed on
+    Replay tampered = replay;
+    auto spawn = std::find_if(tampered.inputs.begin() + tampered.inputs.size() / 2, tampered.inputs.end(),
+                              [](const RecordedInput &recorded) { return recorded.input.type == InputType::SpawnTower; });
+    if (spawn == tampered.inputs.end()) {
+        std::cerr << "The scripted session placed no tower in its second half, use more ticks\n";
+        return EXIT_FAILURE;
+    }
+    spawn->input.position.x += 0.01f;
+    Simulation diverging;
+    if (!begin_replay(diverging, tampered)) return EXIT_FAILURE;
+    ReplayResult tampered_result = run_replay(diverging, tampered);
+    if (tampered_result.diverged_tick != spawn->tick) {
+        std::cerr << "Moved tower at tick " << spawn->tick << " was detected at tick " << tampered_result.diverged_tick << "\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "replay of " << ticks << " ticks with " << replay.inputs.size() << " inputs identical to the session, "
+              << "moved tower detected on its tick " << spawn->tick << "\n";
+    return EXIT_SUCCESS;
+}
+
+auto main(int argc, char **argv) -> int {
+    HeadlessArgs args = parse_args(argc, argv);
+
+    if (args.bench_range_kernel) {
+        return run_range_kernel_benchmark(std::max(args.repetitions, 1));
+    }
+    if (args.check_projectiles) {
+        bool ok = check_projectile_outlives_tower(false) && check_projectile_outlives_tower(true);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (args.bench_flow_field) {
+        return run_flow_field_benchmark(std::max(args.repetitions, 1));
+    }
+    if (args.check_allocations) {
+        bool ok = check_steady_state_allocations(args.enemies > 0 ? args.enemies : 1000, args.towers, std::max(args.threads, 1), args.ticks);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (args.tick_rate <= 0) panic("Tick rate must be positive");
+    if (args.threads == 0) args.threads = args.compare_threads ? std::max(2, static_cast<int>(std::thread::hardware_concurrency())) : 1;
+    if (args.threads < 1) panic("Thread count must be positive");
+    // A single thread runs the serial path, so the comparison would always pass
+    if (args.compare_threads && args.threads < 2) panic("--compare-threads needs at least 2 threads");
+    if (!args.replay_path.empty()) {
+        return run_replay_file(args.replay_path, args.threads);
+    }
+    if (args.bench_snapshot && args.enemies == 0) args.enemies = 100000;
+
+    // The simulation only knows its tick counter, wall time only measures how fast we get through the ticks.
+    Simulation sim;
+    sim.tick_rate = args.tick_rate;
+    sim.use_flow_field = args.flow_field;
+
+    uint32_t rng_state = 0x5eed;
+    for (int i = 0; i < args.towers; ++i) {
+        spawn_tower_at_position(sim, window_normalized_to_ndc(scatter_position(rng_state)));
+    }
+    if (args.enemies > 0) spawn_enemies_along_path(sim, args.enemies, SimConstants::enemy_hp);
+    init_simulation(sim);
+
+    if (args.bench_range_query) {
+        return run_range_query_benchmark(sim, std::max(args.repetitions, 1));
+    }
+    if (args.check_targets) {
+        return run_target_check(sim, args.ticks);
+    }
+    if (args.check_replay) {
+        return run_replay_check(sim, args.ticks, args.record_path);
+    }
+    if (args.bench_snapshot) {
+        return run_snapshot_benchmark(sim, args.snapshot_path, std::max(args.repetitions, 1));
+    }
+
+    ThreadPool thread_pool(args.threads);
+    if (args.threads > 1) sim.thread_pool = &thread_pool;
+
+    if (args.compare_threads) {
+        Simulation reference = sim;
+        reference.thread_pool = nullptr;
+        for (long long tick = 0; tick < args.ticks; ++tick) {
+            tick_simulation(sim);
+            tick_simulation(reference);
+            if (!same_simulation_state(sim, reference)) {
+                std::cerr << "Simulation with " << args.threads << " threads diverged from single threaded at tick " << tick << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+        std::cout << "identical to single threaded for " << args.ticks << " ticks with " << args.threads << " threads\n";
+        return EXIT_SUCCESS;
+    }
+
+    profiler_set_thread_name("main");
+    set_profiler_enabled(!args.trace_path.empty());
+    auto start = std::chrono::steady_clock::now();
+    for (long long tick = 0; tick < args.ticks; ++tick) {
+        tick_simulation(sim);
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    if (!args.trace_path.empty() && !write_chrome_trace(args.trace_path)) return EXIT_FAILURE;
+
+    double ticks_per_second = elapsed.count() > 0.0 ? static_cast<double>(args.ticks) / elapsed.count() : 0.0;
+    std::cout << "ticks: " << args.ticks << "\n"
+              << "enemies: " << sim.game.enemies.size() << "\n"
+              << "towers: " << sim.game.towers.size() << "\n"
+              << "threads: " << args.threads << "\n"
+              << "target candidate refreshes: " << sim.target_refreshes << "\n"
+              << "projectile pool: " << sim.game.projectiles.capacity() << " slots, grew " << sim.game.projectiles.grows << " times\n"
+              << "simulated time (s): " << static_cast<double>(sim.tick) / sim.tick_rate << "\n"
+              << "elapsed (s): " << elapsed.count() << "\n"
+              << "ticks per second: " << ticks_per_second << "\n"
+              << "score: " << sim.game.score << ", life: " << sim.game.life << "\n";
+
+    return EXIT_SUCCESS;
+}
@@ -8,6 +8,7 @@
 #include "imgui.h"
 
 #include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
 #include <glm/glm.hpp>
@@ -15,54 +16,35 @@
 using glm::vec2;
 using glm::vec3;
 
-#include <nlohmann/json.hpp>
-using json = nlohmann::json;
+#include "sim/alloc_counter.hpp"
+#include "sim/clock.hpp"
+#include "sim/frame_arena.hpp"
+#include "sim/profiler.hpp"
+#include "sim/replay.hpp"
+#include "sim/sim.hpp"
+#include "sim/snapshot.hpp"
+#include "sim/spsc_queue.hpp"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cfloat>
 #include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
+#include <filesystem>
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <optional>
 #include <sstream>
-#include <unordered_map>
-
-struct Position {
-    float x;
-    float y;
-
-    Position() = default;
-    Position(float x_, float y_) : x(x_), y(y_) {}
-    Position(const vec2 &v) : x(v.x), y(v.y) {}
-    operator vec2() const { return {x, y}; }
-
-    Position operator+(const vec2 &v) const { return Position{x + v.x, y + v.y}; }
-    Position operator-(const vec2 &v) const { return Position{x - v.x, y - v.y}; }
-    Position &operator+=(const vec2 &v) {
-        x += v.x;
-        y += v.y;
-        return *this;
-    }
-    Position &operator-=(const vec2 &v) {
-        x -= v.x;
-        y -= v.y;
-        return *this;
-    }
-
-    vec2 to_glm() const { return vec2(x, y); }
-};
-
-inline std::ostream &operator<<(std::ostream &os, const Position &p) {
-    return os
-           << "Position("
-           << p.x << ", "
-           << p.y
-           << ")";
-}
-
-inline float distance(const Position &a, const Position &b) {
-    return glm::distance(a.to_glm(), b.to_glm());
-}
+#include <string_view>
+#include <thread>
 
 struct Color {
     float r, g, b;
@@ -104,45 +86,25 @@ using gl_Shader = GLuint;
 using gl_ShaderProgram = GLuint;
 using gl_UBO = GLuint;
 
-auto panic(const std::string &message) -> void {
-    std::cerr << "PANIC: " << message << std::endl;
-    std::exit(EXIT_FAILURE);
-}
-constexpr std::array<float, 51> make_circle_vertices() {
-    std::array<float, 51> v = {
-        0.000000f, 0.000000f, 0.000000f,
-        0.500000f, 0.000000f, 0.000000f,
-        0.461940f, 0.191342f, 0.000000f,
-        0.353553f, 0.353553f, 0.000000f,
-        0.191342f, 0.461940f, 0.000000f,
-        0.000000f, 0.500000f, 0.000000f,
-        -0.191342f, 0.461940f, 0.000000f,
-        -0.353553f, 0.353553f, 0.000000f,
-        -0.461940f, 0.191342f, 0.000000f,
-        -0.500000f, 0.000000f, 0.000000f,
-        -0.461940f, -0.191342f, 0.000000f,
-        -0.353553f, -0.353553f, 0.000000f,
-        -0.191342f, -0.461940f, 0.000000f,
-        -0.000000f, -0.500000f, 0.000000f,
-        0.191342f, -0.461940f, 0.000000f,
-        0.353553f, -0.353553f, 0.000000f,
-        0.461940f, -0.191342f, 0.000000f};
-    for (float &f : v) {
-        f *= 2.0f;
-    }
-    return v;
-}
 struct Constants {
     static constexpr std::string_view window_title = "Tower Defense";
     static constexpr int window_width = 1280;
     static constexpr int window_height = 720;
     static constexpr float aspect_ratio = static_cast<float>(window_width) / window_height;
-
-    static constexpr float path_marker_width = 0.025f;
-    static constexpr float path_marker_height = 0.025f;
-
-    static constexpr std::chrono::duration<float> projectile_life_time = std::chrono::duration<float>(1.0f);
-
+    static_assert(aspect_ratio == SimConstants::aspect_ratio, "Window and simulation NDC space must agree");
+
+    // F5 saves to and F9 loads from `snapshot_path`, F6 exports `snapshot_json_path`
+    static constexpr const char *snapshot_path = "snapshot.bin";
+    static constexpr const char *snapshot_json_path = "snapshot.json";
+    static constexpr const char *autosave_path = "autosave.bin";
+    // F2 or the button in the profiler window dumps the zones still in the profiler rings here
+    static constexpr const char *trace_path = "trace.json";
+    // F3 starts and stops capturing frames into `capture_dir` unless `--capture` named another one
+    static constexpr const char *capture_dir = "capture";
+    // Frame time of offscreen runs, which don't wait for vsync and should produce the same frames every run
+    static constexpr float offscreen_frame_seconds = 1.0f / 60.0f;
+
+    // Unit quad every shape is drawn on, spanning [0, 1] x [-1, 0] from the instance position
     static constexpr std::array<float, 12> square_vertices = {
         1.0f, -1.0f, 0.0f,
         1.0f, 0.0f, 0.0f,
@@ -153,25 +115,6 @@ struct Constants {
         0, 1, 3,
         1, 2, 3};
 
-    static constexpr std::array<float, 9> triangle_vertices = {
-        0.5f, 0.0f, 0.0f,
-        0.0f, -1.0f, 0.0f,
-        1.0f, -1.0f, 0.0f};
-
-    static constexpr std::array<unsigned int, 3> triangle_indices = {
-        0, 1, 2};
-
-    static constexpr auto circle_vertices = make_circle_vertices();
-
-    // Triangle-fan indices  → 16 triangles = 48 indices
-    static constexpr std::array<unsigned int, 48> circle_indices = {
-        0, 1, 2, 0, 2, 3, 0, 3, 4,
-        0, 4, 5, 0, 5, 6, 0, 6, 7,
-        0, 7, 8, 0, 8, 9, 0, 9, 10,
-        0, 10, 11, 0, 11, 12, 0, 12, 13,
-        0, 13, 14, 0, 14, 15, 0, 15, 16,
-        0, 16, 1};
-
     struct Color {
         static constexpr auto white = vec3(1.0f, 1.0f, 1.0f);
         static constexpr auto black = vec3(0.0f, 0.0f, 0.0f);
@@ -180,169 +123,570 @@ struct Constants {
         static constexpr auto blue = vec3(0.0f, 0.0f, 1.0f);
     };
 
-    static constexpr int max_tower_level = 5;
-
     static constexpr const char *fp_shader_dir = "assets/shaders/";
-    static constexpr const char *fp_vertex_shader = "assets/shaders/vertex.glsl";
-    static constexpr const char *fp_fragment_shader = "assets/shaders/fragment.glsl";
-    static constexpr const char *fp_fragment_tower_range_shader = "assets/shaders/fragment_tower_range.glsl";
+    static constexpr const char *fp_shape_vertex_shader = "assets/shaders/shape_vertex.glsl";
+    static constexpr const char *fp_shape_fragment_shader = "assets/shaders/shape_fragment.glsl";
+
+    static constexpr GLuint frame_uniforms_binding = 0;
 };
 
-auto window_normalized_to_ndc(const Position &norm_pos) -> Position {
-    auto pos = Position{
-        norm_pos.x * 2.0f - 1.0f,
-        1.0f - norm_pos.y * 2.0f};
-    pos.x *= Constants::aspect_ratio;
-    return pos;
-}
+/*
+Values every program reads, laid out like the std140 `FrameUniforms` block in the shaders. Written once per
+frame into a single uniform buffer that stays bound to `Constants::frame_uniforms_binding`.
+*/
+struct FrameUniforms {
+    float time;
+    float aspect_ratio;
+    float padding[2];
+};
+static_assert(sizeof(FrameUniforms) % 16 == 0, "std140 blocks are padded to 16 bytes");
 
-auto ndc_to_window_normalized(const Position &ndc_pos) -> Position {
-    auto pos = Position{
-        (ndc_pos.x / Constants::aspect_ratio + 1.0f) * 0.5f,
-        (1.0f - ndc_pos.y) * 0.5f};
-    return pos;
-}
+/*
+Linked program with its uniforms reflected once after linking (`glGetActiveUniform`). Draw code resolves the
+uniforms it needs to slots at load time and from then on only writes through the slot, which is a plain
+glProgramUniform call without hashing or allocation. Members of uniform blocks are not listed, those are
+set through their buffer.
+*/
+struct ShaderProgram {
+    struct UniformInfo {
+        std::string name;
+        GLint location;
+        GLenum type;
+    };
+
+    gl_ShaderProgram id = GL_ZERO;
+    std::vector<UniformInfo> uniforms;
 
-struct Box {
-    Position position;
-    float width;
-    float height;
-    auto get_center() const -> Position {
-        return Position{position.x + width / 2.0f, position.y - height / 2.0f};
+    auto activate() -> void {
+        if (id == GL_ZERO) panic("Trying to activate uninitialized ShaderProgram!");
+        glUseProgram(id);
     }
-    auto is_point_inside(Position pos) const -> bool {
-        return pos.x >= position.x &&
-               pos.x <= position.x + width &&
-               pos.y >= position.y - height &&
-               pos.y <= position.y;
+
+    // Slot of the uniform, panics if the program doesn't have it (or the compiler removed it as unused).
+    auto slot(std::string_view name) const -> int {
+        for (size_t idx = 0; idx < uniforms.size(); ++idx) {
+            if (uniforms[idx].name == name) return static_cast<int>(idx);
+        }
+        panic(std::string("Shader program has no active uniform ") + std::string(name));
+        return -1;
+    }
+    auto set(int slot, float value) -> void {
+        glProgramUniform1f(id, uniforms[slot].location, value);
+    }
+    auto set(int slot, vec2 value) -> void {
+        glProgramUniform2f(id, uniforms[slot].location, value.x, value.y);
+    }
+    auto set(int slot, vec3 value) -> void {
+        glProgramUniform3f(id, uniforms[slot].location, value.x, value.y, value.z);
     }
 };
-inline float distance(const Box &a, const Box &b) {
-    return distance(a.get_center(), b.get_center());
-}
 
-enum class CollisionDirection {
-    None,
-    Left,
-    Right,
-    Top,
-    Bottom
-};
+/*
+Ring of `frames_in_flight` regions in one vertex buffer for data that is rewritten every frame. Each frame
+writes into its own region and fences it once its draws are submitted; a region is only reused after its
+fence from `frames_in_flight` frames ago has signalled, so writes never touch memory the GPU is still
+reading and never stall on it unless the GPU is that far behind.
+
+With ARB_buffer_storage the whole buffer is mapped once, persistently and coherently, and writes are plain
+memcpys. The GL 4.1 core context doesn't guarantee that extension, without it every write maps just the
+range it needs with GL_MAP_UNSYNCHRONIZED_BIT, which the fences make safe in the same way.
+*/
+struct StreamBuffer {
+    static constexpr int frames_in_flight = 3;
+    // Offsets are aligned to this so any vertex attribute type can start at a write
+    static constexpr size_t alignment = 16;
+
+    gl_VBO vbo = GL_ZERO;
+    size_t region_size = 0;
+    bool persistent = false;
+    uint8_t *mapped = nullptr;
+
+    int region = 0;
+    size_t cursor = 0;
+    std::array<GLsync, frames_in_flight> fences{};
+
+    size_t bytes_this_frame = 0;
+    size_t bytes_last_frame = 0;
+    // Frames that had to wait for the GPU before writing, and how often the ring had to grow
+    long long stalls = 0;
+    int grows = 0;
+
+    auto create(size_t region_size_) -> void {
+        region_size = region_size_;
+        size_t total_size = region_size * frames_in_flight;
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+#ifdef GL_ARB_buffer_storage
+        persistent = GLAD_GL_ARB_buffer_storage;
+#endif
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, total_size, nullptr, flags);
+            mapped = static_cast<uint8_t *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, total_size, flags));
+            if (!mapped) panic("Failed to persistently map the stream buffer");
+        } else {
+            glBufferData(GL_ARRAY_BUFFER, total_size, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, GL_ZERO);
+    }
+
+    auto destroy() -> void {
+        for (GLsync &fence : fences) {
+            wait(fence);
+        }
+        if (mapped) {
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, GL_ZERO);
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &vbo);
+        vbo = GL_ZERO;
+    }
 
-auto collision_box_box_directional(const Box &b1, const Box &b2) -> CollisionDirection {
-    float left1 = b1.position.x;
-    float right1 = b1.position.x + b1.width;
-    float top1 = b1.position.y;
-    float bottom1 = b1.position.y - b1.height;
+    /*
+    Replaces the buffer with a bigger one without waiting for the GPU. Deleting the old name only orphans it,
+    GL keeps its storage alive until the draws already issued from it ran, and the new buffer has nothing in
+    flight, so its fences start out empty.
+    */
+    auto grow(size_t new_region_size) -> void {
+        if (mapped) {
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, GL_ZERO);
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &vbo);
+        for (GLsync &fence : fences) {
+            if (fence) glDeleteSync(fence);
+            fence = nullptr;
+        }
+        create(new_region_size);
+        grows += 1;
+    }
 
-    float left2 = b2.position.x;
-    float right2 = b2.position.x + b2.width;
-    float top2 = b2.position.y;
-    float bottom2 = b2.position.y - b2.height;
+    // Blocks until the fence signalled and deletes it, returns true if that meant waiting.
+    static auto wait(GLsync &fence) -> bool {
+        if (!fence) return false;
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        bool waited = result == GL_TIMEOUT_EXPIRED;
+        while (result == GL_TIMEOUT_EXPIRED) {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000);
+        }
+        if (result == GL_WAIT_FAILED) panic("glClientWaitSync failed on the stream buffer");
+        glDeleteSync(fence);
+        fence = nullptr;
+        return waited;
+    }
 
-    bool xcoll = (left1 < right2) &&
-                 (right1 > left2);
-    bool ycoll = (top1 > bottom2) &&
-                 (bottom1 < top2);
-    if (!(xcoll && ycoll)) {
-        return CollisionDirection::None;
+    auto begin_frame() -> void {
+        if (wait(fences[region])) stalls += 1;
+        cursor = 0;
+        bytes_this_frame = 0;
     }
 
-    float c1x = (left1 + right1) * 0.5f;
-    float c1y = (top1 + bottom1) * 0.5f;
-    float c2x = (left2 + right2) * 0.5f;
-    float c2y = (top2 + bottom2) * 0.5f;
+    // Copies `data` into this frame's region and returns its byte offset in `vbo`.
+    auto write(const void *data, size_t size) -> size_t {
+        size_t start = (cursor + alignment - 1) & ~(alignment - 1);
+        if (start + size > region_size) {
+            size_t new_region_size = region_size * 2;
+            while (new_region_size < size) new_region_size *= 2;
+            grow(new_region_size);
+            start = 0;
+        }
+        size_t offset = region * region_size + start;
+        if (persistent) {
+            std::memcpy(mapped + offset, data, size);
+        } else {
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+            void *target = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, flags);
+            if (!target) panic("Failed to map the stream buffer");
+            std::memcpy(target, data, size);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        cursor = start + size;
+        bytes_this_frame += size;
+        return offset;
+    }
 
-    float dx = c2x - c1x;
-    float dy = c2y - c1y;
+    // Fences the region after this frame's draws were issued and moves on to the next one.
+    auto end_frame() -> void {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region = (region + 1) % frames_in_flight;
+        bytes_last_frame = bytes_this_frame;
+    }
+};
+
+/*
+GPU time of the render passes from GL_TIMESTAMP queries: one timestamp before the first pass and one after
+each, so a pass is the difference of its two neighbours. Timestamps rather than GL_TIME_ELAPSED because
+only one elapsed query can be active at a time and they would have to be strictly sequential anyway.
 
-    float penX = (b1.width * 0.5f + b2.width * 0.5f) - std::abs(dx);
-    float penY = (b1.height * 0.5f + b2.height * 0.5f) - std::abs(dy);
+Every frame in flight has its own query set. A set is read back when its slot comes around again, `latency`
+frames later; if the GPU still hasn't got that far the frame is counted as skipped instead of waiting, so the
+timer never stalls the pipeline. Timer queries are core since GL 3.3 and Mesa's llvmpipe implements them,
+a context that still reports no timestamp bits just leaves the timer off.
 
-    if (penX < penY) {
-        return (dx > 0) ? CollisionDirection::Left : CollisionDirection::Right;
-    } else {
-        return (dy > 0) ? CollisionDirection::Bottom : CollisionDirection::Top;
+Resolved frames also go into the "gpu" lane of the profiler, shifted to the profiler clock, so they land
+next to the CPU zones in the timeline and the Chrome trace.
+*/
+struct GpuPassTimer {
+    enum Pass { Clear, Shapes, Capture, ImGuiDraw, NumPass };
+    static constexpr std::array<const char *, NumPass> pass_names = {"clear", "shapes", "capture", "imgui"};
+    static constexpr int latency = 4;
+
+    bool supported = false;
+    std::array<std::array<GLuint, NumPass + 1>, latency> queries{};
+    std::array<bool, latency> pending{};
+    int slot = 0;
+    // Profiler time minus GL time, resynced every frame
+    int64_t gl_to_profiler_ns = 0;
+    ProfileRing *ring = nullptr;
+
+    std::array<float, NumPass> last_ms{};
+    // Exponential moving average over roughly the last 20 resolved frames
+    std::array<float, NumPass> average_ms{};
+    long long resolved = 0;
+    long long skipped = 0;
+
+    auto create() -> void {
+        GLint bits = 0;
+        glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+        supported = bits > 0;
+        if (!supported) return;
+        for (auto &set : queries) {
+            glGenQueries(static_cast<GLsizei>(set.size()), set.data());
+        }
+        ring = &profiler_add_ring("gpu");
     }
-}
 
-auto collision_box_box(const Box b1, const Box b2) -> bool {
-    bool xcoll = b1.position.x < b2.position.x + b2.width &&
-                 b1.position.x + b1.width > b2.position.x;
+    auto destroy() -> void {
+        if (!supported) return;
+        for (auto &set : queries) {
+            glDeleteQueries(static_cast<GLsizei>(set.size()), set.data());
+        }
+        supported = false;
+    }
 
-    bool ycoll = b1.position.y > b2.position.y - b2.height &&
-                 b1.position.y - b1.height < b2.position.y;
+    auto resolve(int frame) -> void {
+        if (!pending[frame]) return;
+        pending[frame] = false;
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries[frame].back(), GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            skipped += 1;
+            return;
+        }
+        std::array<GLuint64, NumPass + 1> stamps;
+        for (size_t i = 0; i < stamps.size(); ++i) {
+            glGetQueryObjectui64v(queries[frame][i], GL_QUERY_RESULT, &stamps[i]);
+        }
+        for (int pass = 0; pass < NumPass; ++pass) {
+            last_ms[pass] = static_cast<float>(stamps[pass + 1] - stamps[pass]) / 1e6f;
+            average_ms[pass] = resolved == 0 ? last_ms[pass] : 0.95f * average_ms[pass] + 0.05f * last_ms[pass];
+        }
+        resolved += 1;
 
-    return xcoll && ycoll;
-}
+        if (!profiler_enabled()) return;
+        auto to_profiler = [&](GLuint64 stamp) { return static_cast<int64_t>(stamp) + gl_to_profiler_ns; };
+        for (int pass = 0; pass < NumPass; ++pass) {
+            ring->push(pass_names[pass], to_profiler(stamps[pass]), to_profiler(stamps[pass + 1]), 1);
+        }
+        ring->push("gpu frame", to_profiler(stamps.front()), to_profiler(stamps.back()), 0);
+    }
 
-struct Enemy {
-    int id;
-    bool is_active;
-    int hp;
-    int hp_max;
-    Box box;
-    int pathfinding_target = -1;
+    // Reads back the frame that used this slot `latency` frames ago and stamps the start of this one.
+    auto begin_frame() -> void {
+        if (!supported) return;
+        resolve(slot);
+        GLint64 gl_now = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gl_now);
+        gl_to_profiler_ns = profiler_now_ns() - gl_now;
+        glQueryCounter(queries[slot][0], GL_TIMESTAMP);
+    }
 
-    auto death() -> void {
-        this->is_active = false;
+    // Stamps the end of `pass`, passes have to be ended in order.
+    auto end_pass(Pass pass) -> void {
+        if (!supported) return;
+        glQueryCounter(queries[slot][pass + 1], GL_TIMESTAMP);
     }
-    auto take_damage(int amount) -> void {
-        hp -= amount;
-        if (hp <= 0) death();
+
+    auto end_frame() -> void {
+        if (!supported) return;
+        pending[slot] = true;
+        slot = (slot + 1) % latency;
     }
 };
 
-enum class TowerType {
-    Fire,
-    Ice,
-    Buff,
-    NumTowerType
-};
-struct Tower;
-
-struct Projectile {
-    int tower_idx;
-    bool is_active = false;
-    std::chrono::steady_clock::time_point spawn_time;
-    Box box;
-    vec2 dir;
-};
-struct EnemyInRange {
-    int id;
-    float distance;
-};
-struct Tower {
-    int id;
-    bool is_active;
-    TowerType type;
-    Box box;
-    int level;
-    std::vector<EnemyInRange> enemies_in_range;
-    std::array<Projectile, 6> projectiles;
-    std::chrono::steady_clock::time_point time_of_last_shot;
-
-    auto find_closest_enemy() const -> std::optional<int> {
-        if (enemies_in_range.empty()) return std::nullopt;
-        auto min_it = std::min_element(
-            enemies_in_range.begin(), enemies_in_range.end(),
-            [](const EnemyInRange &a, const EnemyInRange &b) {
-                return a.distance < b.distance;
-            });
-
-        return min_it->id;
+/*
+Frame capture for recordings and visual regression images. While `active` the world is drawn into `fbo`
+instead of the window; after the shape pass the frame is read into the next of `pbo_count` pixel pack
+buffers, which returns as soon as the copy is queued, and then blitted to the window for ImGui to draw over,
+so captures show the world without the UI. A pixel buffer is mapped only once its fence from a later frame
+signalled, so glReadPixels never waits on the GPU unless the GPU is `pbo_count` frames behind.
+
+The mapped pixels are copied, flipped to top-down rows, into one of `buffer_count` preallocated frame
+buffers and handed to the writer threads, which encode and write one file per frame. When the writers fall
+behind by that many frames a frame is dropped (and counted) rather than holding up the render loop; with
+`never_drop`, for offscreen runs where every frame matters, the render loop waits for a writer instead.
+*/
+struct FrameCapture {
+    enum class Format { Png, Raw };
+    static constexpr int pbo_count = 3;
+    static constexpr int buffer_count = 8;
+    static constexpr int width = Constants::window_width;
+    static constexpr int height = Constants::window_height;
+    static constexpr size_t frame_bytes = static_cast<size_t>(width) * height * 4;
+
+    std::string dir;
+    Format format = Format::Png;
+    bool created = false;
+    bool active = false;
+    bool never_drop = false;
+
+    GLuint fbo = GL_ZERO;
+    GLuint color_rb = GL_ZERO;
+    std::array<GLuint, pbo_count> pbos{};
+    std::array<GLsync, pbo_count> fences{};
+    std::array<long long, pbo_count> pbo_frames{};
+    int pbo_slot = 0;
+
+    // Everything below `mutex` is shared with the writers
+    std::array<std::vector<uint8_t>, buffer_count> buffers;
+    std::vector<std::thread> writers;
+    std::mutex mutex;
+    std::condition_variable cv;
+    struct Job {
+        int buffer;
+        long long frame;
+    };
+    // FIFO of filled buffers, there can't be more jobs than buffers
+    std::array<Job, buffer_count> jobs{};
+    int job_head = 0;
+    int job_count = 0;
+    std::array<int, buffer_count> free_buffers{};
+    int free_count = 0;
+    bool stopping = false;
+
+    // Frames read back from the GPU so far, the next one gets this number
+    long long frames_read = 0;
+    long long frames_dropped = 0;
+    // Counted by the writers, a frame that failed to write counts only as a failure
+    std::atomic<long long> frames_written{0};
+    std::atomic<long long> write_failures{0};
+    // Reads that had to wait for the GPU, or with `never_drop` for a writer
+    long long stalls = 0;
+
+    auto create(const std::string &dir_, Format format_, int writer_count) -> bool {
+        dir = dir_;
+        format = format_;
+        std::error_code error;
+        std::filesystem::create_directories(dir, error);
+        if (error) {
+            std::cerr << "Error: cannot create capture directory " << dir << ": " << error.message() << "\n";
+            return false;
+        }
+
+        glGenRenderbuffers(1, &color_rb);
+        glBindRenderbuffer(GL_RENDERBUFFER, color_rb);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, GL_ZERO);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_rb);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) panic("Capture framebuffer is incomplete");
+        glBindFramebuffer(GL_FRAMEBUFFER, GL_ZERO);
+
+        glGenBuffers(pbo_count, pbos.data());
+        for (GLuint pbo : pbos) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, frame_bytes, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, GL_ZERO);
+
+        for (int idx = 0; idx < buffer_count; ++idx) {
+            buffers[idx].resize(frame_bytes);
+            free_buffers[idx] = idx;
+        }
+        free_count = buffer_count;
+        for (int idx = 0; idx < std::max(writer_count, 1); ++idx) {
+            writers.emplace_back([this]() { writer_loop(); });
+        }
+        created = true;
+        return true;
     }
-};
 
-struct ShaderProgram {
-    gl_ShaderProgram id;
-    std::unordered_map<std::string, gl_UBO> ubos;
-    auto activate() -> void {
-        if (id == GL_ZERO) panic("Trying to activate uninitialized ShaderProgram!");
-        glUseProgram(id);
+    auto writer_loop() -> void {
+        profiler_set_thread_name("capture writer");
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [&]() { return job_count > 0 || stopping; });
+            if (job_count == 0) return;
+            Job job = jobs[job_head];
+            job_head = (job_head + 1) % buffer_count;
+            job_count -= 1;
+            lock.unlock();
+            bool written = write_frame(job);
+            lock.lock();
+            free_buffers[free_count++] = job.buffer;
+            if (written) {
+                frames_written += 1;
+            } else {
+                write_failures += 1;
+            }
+            cv.notify_all();
+        }
+    }
+
+    auto write_frame(const Job &job) -> bool {
+        TD_PROFILE_ZONE("FrameCapture::write_frame");
+        char path[512];
+        const char *extension = format == Format::Png ? "png" : "rgba";
+        std::snprintf(path, sizeof(path), "%s/frame_%06lld.%s", dir.c_str(), job.frame, extension);
+        const std::vector<uint8_t> &pixels = buffers[job.buffer];
+        if (format == Format::Png) {
+            return stbi_write_png(path, width, height, 4, pixels.data(), width * 4) != 0;
+        }
+        // stdio rather than a stream, which would allocate its buffer for every file
+        std::FILE *file = std::fopen(path, "wb");
+        if (!file) return false;
+        bool written = std::fwrite(pixels.data(), 1, pixels.size(), file) == pixels.size();
+        return std::fclose(file) == 0 && written;
+    }
+
+    // Redirects this frame's drawing into the capture framebuffer.
+    auto begin_frame() -> void {
+        if (!active) return;
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    }
+
+    // Copies the pixel buffer of `slot` out to a writer, returns false if it isn't ready and `block` is off.
+    auto collect(int slot, bool block) -> bool {
+        if (!fences[slot]) return true;
+        if (!block) {
+            GLenum status = glClientWaitSync(fences[slot], 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED) return false;
+        }
+        if (StreamBuffer::wait(fences[slot])) stalls += 1;
+
+        int buffer = -1;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (free_count == 0 && never_drop) {
+                stalls += 1;
+                cv.wait(lock, [&]() { return free_count > 0; });
+            }
+            if (free_count > 0) buffer = free_buffers[--free_count];
+        }
+        if (buffer < 0) {
+            frames_dropped += 1;
+            return true;
+        }
+
+        TD_PROFILE_ZONE("FrameCapture::collect");
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+        const auto *mapped = static_cast<const uint8_t *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame_bytes, GL_MAP_READ_BIT));
+        if (!mapped) panic("Failed to map a capture pixel buffer");
+        // GL rows start at the bottom, image files at the top
+        constexpr size_t row_bytes = static_cast<size_t>(width) * 4;
+        uint8_t *pixels = buffers[buffer].data();
+        for (int row = 0; row < height; ++row) {
+            std::memcpy(pixels + row * row_bytes, mapped + (height - 1 - row) * row_bytes, row_bytes);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, GL_ZERO);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs[(job_head + job_count) % buffer_count] = Job{buffer, pbo_frames[slot]};
+            job_count += 1;
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    // Queues the readback of the frame drawn so far, hands finished older ones to the writers and shows the frame.
+    auto end_frame() -> void {
+        if (!active) return;
+        collect(pbo_slot, true);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[pbo_slot]);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, GL_ZERO);
+        fences[pbo_slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        pbo_frames[pbo_slot] = frames_read++;
+        pbo_slot = (pbo_slot + 1) % pbo_count;
+        // Oldest first, a frame is only ever written after the ones before it were handed out
+        for (int offset = 0; offset < pbo_count; ++offset) {
+            if (!collect((pbo_slot + offset) % pbo_count, false)) break;
+        }
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GL_ZERO);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, GL_ZERO);
+    }
+
+    // Collects every pending frame and waits until the writers wrote all of them.
+    auto flush() -> void {
+        never_drop = true;
+        for (int offset = 0; offset < pbo_count; ++offset) {
+            collect((pbo_slot + offset) % pbo_count, true);
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return job_count == 0 && free_count == buffer_count; });
+    }
+
+    auto destroy() -> void {
+        if (!created) return;
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (std::thread &writer : writers) {
+            writer.join();
+        }
+        writers.clear();
+        glDeleteBuffers(pbo_count, pbos.data());
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color_rb);
+        created = false;
+        active = false;
     }
 };
 
+// Encoding a PNG of a full frame can take longer than a 60 fps frame, so a recording needs several writers.
+auto default_capture_writers() -> int {
+    return std::max(2, static_cast<int>(std::thread::hardware_concurrency()) / 2);
+}
+
+// Shape the fragment shader evaluates for an instance, must match the constants in shape_fragment.glsl.
+enum ShapeKind : uint32_t {
+    ShapeRect = 0,
+    ShapeTriangle = 1,
+    ShapeCircle = 2,
+    // Flag on top of the kind: translucent, pulsing tower range look instead of the flat fill
+    ShapeRange = 16,
+};
+
+/*
+Draw layers of the shape batch, back to front. Instances are pushed in whatever order the snapshot is walked
+and sorted by layer right before the draw, so a tower and its range can be pushed together.
+*/
+enum ShapeLayer : uint8_t { LayerTowers, LayerMarkers, LayerEnemies, LayerProjectiles, LayerHighlight, LayerRanges, NumLayers };
+
+// One instance of a shape draw, matches the per-instance attributes (locations 1 to 5) of shape_vertex.glsl.
+struct InstanceData {
+    float x, y;
+    float width, height;
+    float r, g, b, a;
+    // Width of the outline to draw instead of the filled shape, 0 fills it
+    float outline;
+    uint32_t shape;
+};
+
 struct s_Color {
     Color background = Color::from_u8(15, 15, 21);
     Color path_marker{1.0f, 0.0f, 1.0f};
@@ -351,62 +695,298 @@ struct s_Color {
     Color tower_ice{0.5f, 0.5f, 0.9f};
     Color tower_buff{0.3f, 1.0f, 0.4f};
     Color tower_radius{0.1f, 0.8f, 0.0f};
+    float tower_radius_alpha = 0.3f;
     Color projectile{1.0f, 1.0f, 1.0f};
+    Color highlight{1.0f, 0.9f, 0.1f};
 };
 
-struct GameState {
+/*
+Everything the GL thread needs to draw a frame and fill the debug window, copied out of the simulation after
+its ticks. Boxes are already interpolated with the frame's render alpha. Vectors are cleared and refilled, so
+after the first frames no snapshot allocates.
+*/
+struct RenderSnapshot {
+    struct EnemyView {
+        Box box;
+        float health_pct;
+        EnemyId id;
+        float progress;
+        int hp;
+        int hp_max;
+    };
+    struct TowerView {
+        Box box;
+        TowerType type;
+        float range;
+        bool is_active;
+        int level;
+        TargetingPolicy targeting;
+    };
+    struct ProjectileView {
+        Box box;
+        int tower_idx;
+        int damage;
+    };
+    struct TargetView {
+        int tower_idx;
+        EnemyInRange enemy;
+    };
+
+    long long tick = 0;
+    int tick_rate = 0;
+    int ticks_this_frame = 0;
+    long long dropped_ticks = 0;
+    float alpha = 0.0f;
     int score = 0;
-    int life = 10;
-
-    std::vector<Enemy> enemies = {
-        Enemy{0, true, 100, 100, Box{window_normalized_to_ndc(Position{0.441f, 0.467f}), 0.05f, 0.05f}},
-        Enemy{1, true, 250, 500, Box{window_normalized_to_ndc(Position{0.271f, 0.768f}), 0.05f, 0.05f}},
-        Enemy{2, true, 300, 300, Box{window_normalized_to_ndc(Position{0.668f, 0.160f}), 0.05f, 0.05f}},
-        Enemy{3, true, 300, 300, Box{window_normalized_to_ndc(Position{0.339844f, 0.452778f}), 0.05f, 0.05f}},
-        Enemy{4, true, 300, 300, Box{window_normalized_to_ndc(Position{0.386719f, 0.255556f}), 0.05f, 0.05f}},
-        Enemy{5, true, 300, 300, Box{window_normalized_to_ndc(Position{0.514063f, 0.126389f}), 0.05f, 0.05f}},
-        Enemy{6, true, 300, 300, Box{window_normalized_to_ndc(Position{0.760156f, 0.658333f}), 0.05f, 0.05f}},
-        Enemy{7, true, 300, 300, Box{window_normalized_to_ndc(Position{0.721875f, 0.851389f}), 0.05f, 0.05f}},
-        Enemy{8, true, 300, 300, Box{window_normalized_to_ndc(Position{0.49375f, 0.866667f}), 0.05f, 0.05f}},
-        Enemy{9, true, 300, 300, Box{window_normalized_to_ndc(Position{0.464844f, 0.690278f}), 0.05f, 0.05f}}};
-
-    std::vector<Tower> towers = {
-        Tower{0, true, TowerType::Fire, Box{window_normalized_to_ndc(Position{0.146f, 0.516f}), 0.1f, 0.1f}, 1},
-        Tower{1, true, TowerType::Ice, Box{window_normalized_to_ndc(Position{0.827f, 0.276f}), 0.1f, 0.1f}, 3},
-        Tower{2, true, TowerType::Buff, Box{window_normalized_to_ndc(Position{0.55f, 0.400f}), 0.1f, 0.1f}, 4}};
+    int life = 0;
+
+    std::vector<Box> path_markers;
+    std::vector<EnemyView> enemies;
+    // Indexed like `GameState::towers`, disabled ones included
+    std::vector<TowerView> towers;
+    std::vector<ProjectileView> projectiles;
+    // Grouped by tower, in tower order
+    std::vector<TargetView> targets;
+};
 
-    /*
-    auto GameState::serialise() -> void {
-        std::ofstream out("gamestate.json");
-        if (!out) panic("Failed to open gamestate.json for writing");
-        out << std::setw(2) << json(*this) << "\n";
+auto fill_render_snapshot(const Simulation &sim, const FixedStepClock &clock, int ticks_this_frame, RenderSnapshot &out) -> void {
+    TD_PROFILE_ZONE("fill_render_snapshot");
+    float alpha = clock.alpha();
+    out.tick = sim.tick;
+    out.tick_rate = sim.tick_rate;
+    out.ticks_this_frame = ticks_this_frame;
+    out.dropped_ticks = clock.dropped_ticks;
+    out.alpha = alpha;
+    out.score = sim.game.score;
+    out.life = sim.game.life;
+
+    out.path_markers.assign(sim.path_markers.begin(), sim.path_markers.end());
+
+    const EnemyStore &enemies = sim.game.enemies;
+    out.enemies.clear();
+    for (int slot = 0; slot < enemies.size(); ++slot) {
+        float health_pct = static_cast<float>(enemies.hp[slot]) / enemies.hp_max[slot];
+        out.enemies.push_back(RenderSnapshot::EnemyView{enemies.interpolated_box(slot, alpha), health_pct, enemies.id[slot], enemies.progress[slot],
+                                                        enemies.hp[slot], enemies.hp_max[slot]});
     }
 
-    auto GameState::deserialise() -> void {
-        std::ifstream in("gamestate.json");
-        if (!in) panic("Failed to open gamestate.json for reading");
-        json j;
-        in >> j;
-        *this = j.get<GameState>();
+    out.towers.clear();
+    out.projectiles.clear();
+    out.targets.clear();
+    for (size_t tower_idx = 0; tower_idx < sim.game.towers.size(); ++tower_idx) {
+        const Tower &tower = sim.game.towers[tower_idx];
+        for (const EnemyInRange &eir : tower.targets.in_range) {
+            out.targets.push_back(RenderSnapshot::TargetView{static_cast<int>(tower_idx), eir});
+        }
+        out.towers.push_back(RenderSnapshot::TowerView{tower.box, tower.type, sim.table_tower_range[tower.level], tower.is_active,
+                                                       tower.level, tower.targeting});
+    }
+    // Including the ones fired by towers that were disabled since
+    const ProjectileStore &projectiles = sim.game.projectiles;
+    for (int slot = 0; slot < projectiles.size(); ++slot) {
+        out.projectiles.push_back(RenderSnapshot::ProjectileView{projectiles.interpolated_box(slot, alpha), projectiles.tower_idx[slot], projectiles.damage[slot]});
+    }
+}
+
+/*
+Runs the simulation part of a frame (inputs, ticks, snapshot) on its own thread. The GL thread kicks frame
+N + 1 and then draws the snapshot of frame N while the ticks run, `wait` hands over the finished snapshot.
+
+The simulation, its clock and the back snapshot are only touched by the sim thread between `kick` and
+`wait`, the front snapshot only by the GL thread. Input goes through the lock-free `inputs` queue, so the
+GL thread never blocks on a running tick to deliver it.
+
+Saves and loads are requested through flags and carried out at the start of the next frame. A save only
+encodes on the sim thread and leaves writing the file to `snapshot_write`, the disk never holds up a tick.
+
+With a `record_path` every applied input and tick goes into `replay`, written out on `stop`. Loading a
+snapshot starts the recording over from the loaded state.
+*/
+struct SimThread {
+    Simulation sim;
+    // Fixed step of the simulation, rendering interpolates between the last two ticks
+    FixedStepClock clock{SimConstants::default_tick_rate};
+    SpscQueue<InputCommand, 1024> inputs;
+
+    std::array<RenderSnapshot, 2> snapshots;
+    int front = 0;
+
+    // Runs every frame inline on the caller when false, same results, no overlap
+    bool pipelined = true;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool frame_pending = false;
+    bool frame_done = true;
+    bool stopping = false;
+    std::chrono::duration<float> frame_elapsed{0.0f};
+
+    std::atomic<bool> save_requested{false};
+    std::atomic<bool> load_requested{false};
+    std::atomic<bool> export_requested{false};
+    // Ticks between autosaves, 0 disables them
+    long long autosave_ticks = 0;
+    long long last_autosave_tick = 0;
+    // Owned by the write in flight until it finished
+    std::vector<std::byte> snapshot_buffer;
+    std::future<bool> snapshot_write;
+
+    std::string record_path;
+    Replay replay;
+
+    auto front_snapshot() const -> const RenderSnapshot & { return snapshots[front]; }
+
+    auto finish_snapshot_write() -> void {
+        if (snapshot_write.valid() && !snapshot_write.get()) std::cerr << "Snapshot was not saved\n";
+    }
+
+    auto save_in_background(const char *path) -> void {
+        finish_snapshot_write();
+        encode_snapshot(sim, snapshot_buffer);
+        snapshot_write = std::async(std::launch::async, [this, path]() { return write_snapshot_file(path, snapshot_buffer); });
+    }
+
+    auto handle_snapshot_requests() -> void {
+        if (save_requested.exchange(false)) save_in_background(Constants::snapshot_path);
+        if (export_requested.exchange(false)) export_snapshot_json(sim, Constants::snapshot_json_path);
+        if (load_requested.exchange(false)) {
+            // A save still in flight could be the very file we are about to load
+            finish_snapshot_write();
+            if (load_snapshot(sim, Constants::snapshot_path)) {
+                last_autosave_tick = sim.tick;
+                if (!record_path.empty()) start_recording(sim, replay);
+            }
+        }
+        if (autosave_ticks > 0 && sim.tick - last_autosave_tick >= autosave_ticks) {
+            last_autosave_tick = sim.tick;
+            save_in_background(Constants::autosave_path);
+        }
+    }
+
+    auto run_frame(std::chrono::duration<float> elapsed) -> void {
+        TD_PROFILE_ZONE("SimThread::run_frame");
+        handle_snapshot_requests();
+        InputCommand input;
+        while (inputs.pop(input)) {
+            if (!record_path.empty()) record_input(sim, replay, input);
+            apply_input(sim, input);
+        }
+        int ticks = clock.advance(elapsed);
+        for (int tick = 0; tick < ticks; ++tick) {
+            tick_simulation(sim);
+            if (!record_path.empty()) record_tick(sim, replay);
+        }
+        fill_render_snapshot(sim, clock, ticks, snapshots[1 - front]);
+    }
+
+    auto start() -> void {
+        // The first front snapshot exists before any frame ran
+        fill_render_snapshot(sim, clock, 0, snapshots[front]);
+        if (!record_path.empty()) start_recording(sim, replay);
+        if (!pipelined) return;
+        thread = std::thread([this]() {
+            profiler_set_thread_name("sim");
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                cv.wait(lock, [&]() { return frame_pending || stopping; });
+                if (stopping) return;
+                frame_pending = false;
+                lock.unlock();
+                run_frame(frame_elapsed);
+                lock.lock();
+                frame_done = true;
+                cv.notify_all();
+            }
+        });
+    }
+
+    auto kick(std::chrono::duration<float> elapsed) -> void {
+        if (!pipelined) {
+            run_frame(elapsed);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            frame_elapsed = elapsed;
+            frame_done = false;
+            frame_pending = true;
+        }
+        cv.notify_all();
+    }
+
+    // Blocks until the kicked frame finished and makes its snapshot the front one.
+    auto wait() -> void {
+        TD_PROFILE_ZONE("SimThread::wait");
+        if (pipelined) {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return frame_done; });
+        }
+        front = 1 - front;
+    }
+
+    auto stop() -> void {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            cv.notify_all();
+            thread.join();
+        }
+        finish_snapshot_write();
+        if (!record_path.empty() && save_replay(replay, record_path)) {
+            std::cout << "Recorded " << replay.hashes.size() << " ticks to " << record_path << "\n";
+        }
     }
-    */
+};
+
+/*
+State of the entity tables in the Debug window. The rows are filtered and sorted into the frame arena every
+frame, and only the rows the clipper shows get formatted, so an open table costs about the same with 100
+enemies as with 100k.
+*/
+struct InspectorState {
+    // Enemies in range of and projectiles fired by this tower, -1 for all
+    int tower_filter = -1;
+    // Enemies with less than this share of their max HP, 100 shows all
+    int hp_below_pct = 100;
+    bool active_towers_only = false;
+    // Outlined in the world
+    std::optional<EnemyId> highlighted_enemy;
+    int highlighted_tower = -1;
 };
 
 struct Global {
     SDL_Window *window = nullptr;
     bool running = false;
+    // Hidden window on SDL's offscreen (EGL) video driver, with a fixed frame time
+    bool offscreen = false;
 
     ImGuiIO imgui_io;
     SDL_GLContext gl_context;
 
-    ShaderProgram shader_program_single_color;
-    ShaderProgram shader_program_tower_range;
+    ShaderProgram shader_program_shapes;
+    gl_UBO frame_ubo;
 
     gl_VAO vao_square;
-    gl_VAO vao_circle;
-    gl_VAO vao_triangle;
     gl_VAO vao_NONE = GL_ZERO; // TODO: Maybe move this to Constants
 
+    // Per-instance attributes of the shape batch, rewritten every frame
+    StreamBuffer instance_stream;
+    GpuPassTimer gpu_timer;
+    FrameCapture capture;
+    // Stops the game once this many frames were captured, 0 runs until quit
+    long long capture_frame_limit = 0;
+    // Transient lists of the current frame, reset at its start
+    FrameArena frame_arena;
+    // Instances of the shape batch and the layer of each, in the order they were pushed
+    ArenaList<InstanceData> instances{frame_arena};
+    ArenaList<uint8_t> instance_layers{frame_arena};
+    // Heap allocations of all threads during the last frame, and the most any frame made
+    AllocationCounts frame_start_allocations;
+    AllocationCounts last_frame_allocations;
+    uint64_t worst_frame_allocations = 0;
+
     s_Color color;
 
     Position mouse_pos;
@@ -416,248 +996,456 @@ struct Global {
     std::chrono::steady_clock::time_point frame_start_time;
     std::chrono::duration<float> delta_time;
     std::chrono::duration<float> runtime;
+    // Rolling window of the last frame times for the profiler window, `frame_times_ms[frame_counter % size]` is the newest
+    std::array<float, 240> frame_times_ms{};
 
-    // Index into those with the tower level
-    std::array<float, Constants::max_tower_level> table_tower_range = {0.25f, 0.3f, 0.35f, 0.4f, 0.45f};
-    std::array<float, Constants::max_tower_level> table_tower_damage = {5, 10, 20, 40, 50};
-    std::array<float, Constants::max_tower_level> table_tower_firing_delay = {1.0f, 0.9f, 0.8f, 0.7f, 0.5f};
-
-    std::array<Box, 15>
-        path_markers = {
-            Box{window_normalized_to_ndc(Position{0.131f, 0.931f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.133f, 0.729f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.173f, 0.573f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.243f, 0.436f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.350f, 0.204f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.411f, 0.163f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.441f, 0.227f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.477f, 0.355f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.524f, 0.583f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.596f, 0.820f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.667f, 0.786f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.710f, 0.558f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.716f, 0.368f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.774f, 0.226f}), Constants::path_marker_width, Constants::path_marker_height},
-            Box{window_normalized_to_ndc(Position{0.939f, 0.166f}), Constants::path_marker_width, Constants::path_marker_height}};
+    // Zones of the profiler timeline, only recollected while not paused
+    std::vector<ProfileThreadEvents> profile_threads;
+    int64_t profile_window_end_ns = 0;
+    float profile_window_ms = 50.0f;
+    bool profile_paused = false;
 
     int gl_success;
     char gl_error_buffer[512];
 
-    GameState game;
+    SimThread sim_thread;
+    InspectorState inspector;
 };
 Global global;
 
-auto tower_init_projectiles(Tower &tower) -> void {
-    tower.time_of_last_shot = global.frame_start_time;
-    for (auto &p : tower.projectiles) {
-        p.tower_idx = tower.id;
-    }
-}
-auto init_global() -> void {
-    for (auto &tower : global.game.towers) {
-        tower_init_projectiles(tower);
-    }
+auto handle_gl_error(const char *reason) -> void {
+    std::cerr << reason << "\n"
+              << global.gl_error_buffer << "\n";
+    panic("GL Error");
 }
 
-auto spawn_tower_at_position(const Position &position) -> void {
-    auto box = Box{position, 0.1f, 0.1f};
-    int tower_id = global.game.towers.size();
-    auto tower = Tower{tower_id, true, TowerType::Fire, box, 0};
-    tower_init_projectiles(tower);
-    global.game.towers.push_back(tower);
-}
+auto format_time(std::chrono::system_clock::time_point tp) -> const char * {
+    static char buffer[64];
+
+    std::time_t time = std::chrono::system_clock::to_time_t(tp);
+    std::tm *tm_ptr = std::localtime(&time);
 
-auto emplace_enemy(Enemy enemy) -> void {
-    enemy.id = global.game.enemies.size();
-    global.game.enemies.push_back(enemy);
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", tm_ptr);
+    return buffer;
 }
 
-auto spawn_enemy_at_position(const Position &position) -> void {
-    auto box = Box{position, 0.05f, 0.05f};
-    emplace_enemy(Enemy{0, true, 100, 100, box});
+auto format_duration(std::chrono::duration<float> duration) -> const char * {
+    static char buffer[32];
+    auto total_ms = static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
+
+    auto hrs = total_ms / (60 * 60 * 1000);
+    total_ms %= (60 * 60 * 1000);
+    auto mins = total_ms / (60 * 1000);
+    total_ms %= (60 * 1000);
+    auto secs = total_ms / 1000;
+    auto millis = total_ms % 1000;
+
+    std::snprintf(
+        buffer, sizeof(buffer),
+        "%02lld:%02lld:%02lld.%03lld",
+        hrs, mins, secs, millis);
+
+    return buffer;
 }
 
-auto advance_pathfinding_target(Enemy &enemy) -> void {
-    if (enemy.pathfinding_target == -1) panic("Trying to advance not initialised pathfinding target");
-    enemy.pathfinding_target += 1;
-    bool has_reached_end = (enemy.pathfinding_target == global.path_markers.size());
-    if (has_reached_end) {
-        global.game.life -= 1;
-        enemy.box.position = global.path_markers[0].position;
-        enemy.pathfinding_target = 0;
-        enemy.hp = enemy.hp_max;
+// Same color for the same zone name in every frame, whichever translation unit the literal came from.
+auto profiler_zone_color(const char *name) -> ImU32 {
+    uint32_t hash = 2166136261u;
+    for (const char *c = name; *c; ++c) {
+        hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
     }
+    float r, g, b;
+    ImGui::ColorConvertHSVtoRGB(static_cast<float>(hash % 360) / 360.0f, 0.5f, 0.9f, r, g, b);
+    return ImGui::ColorConvertFloat4ToU32(ImVec4(r, g, b, 1.0f));
 }
 
-auto on_tick_enemy(Enemy &enemy) -> void {
-    if (!enemy.is_active) return;
-
-    bool no_target = enemy.pathfinding_target == -1;
-    if (no_target) {
-        float min_dist = 100000.0f;
-        int min_idx = -1;
-        if (enemy.pathfinding_target == -1) {
-            for (size_t marker_idx = 0; marker_idx < global.path_markers.size(); ++marker_idx) {
-                // make this center to center distance instead
-                auto &marker = global.path_markers[marker_idx];
-                float dist = distance(enemy.box, marker);
-                if (dist < min_dist) {
-                    min_dist = dist;
-                    min_idx = marker_idx;
-                }
-            }
-        }
-        enemy.pathfinding_target = min_idx;
-    }
-    { // Movement
-        auto &target = global.path_markers[enemy.pathfinding_target];
-        float dist_to_target = distance(target.position, enemy.box.position);
-        if (dist_to_target < 0.01f) {
-            advance_pathfinding_target(enemy);
+// One lane per thread, one row per nesting depth, zones clipped to [begin_ns, end_ns].
+auto draw_profiler_timeline(const std::vector<ProfileThreadEvents> &threads, int64_t begin_ns, int64_t end_ns) -> void {
+    constexpr float row_height = 18.0f;
+    ImDrawList *draw_list = ImGui::GetWindowDrawList();
+    float width = std::max(ImGui::GetContentRegionAvail().x, 1.0f);
+    double px_per_ns = width / static_cast<double>(std::max<int64_t>(end_ns - begin_ns, 1));
+    ImVec2 mouse = ImGui::GetIO().MousePos;
+    for (const ProfileThreadEvents &thread : threads) {
+        int max_depth = 0;
+        for (const ProfileZoneEvent &event : thread.events) {
+            max_depth = std::max(max_depth, event.depth);
         }
-        vec2 dir = normalize((target.position - enemy.box.position).to_glm());
-        enemy.box.position += dir * 0.001f;
-    }
-    { // Combining enemies
-
-        for (auto &other : global.game.enemies) {
-            if (!other.is_active) continue;
-            if (enemy.id == other.id) continue;
-            if (collision_box_box(enemy.box, other.box)) {
-                { // height
-                    float big = std::max(enemy.box.height, other.box.height);
-                    float small = std::min(enemy.box.height, other.box.height);
-                    enemy.box.height = big + small / 5.0f;
-                }
-                { // width
-                    float big = std::max(enemy.box.width, other.box.width);
-                    float small = std::min(enemy.box.width, other.box.width);
-                    enemy.box.width = big + small / 5.0f;
-                }
-                { // max HP
-                    int big = std::max(enemy.hp_max, other.hp_max);
-                    int small = std::min(enemy.hp_max, other.hp_max);
-                    enemy.hp_max = big + small / 5.0f;
-                }
-                { // current HP
-                    int big = std::max(enemy.hp, other.hp);
-                    int small = std::min(enemy.hp, other.hp);
-                    enemy.hp = big + small / 5.0f;
-                    if (enemy.hp > enemy.hp_max)
-                        enemy.hp = enemy.hp_max;
-                }
-
-                other.is_active = false;
+        ImGui::TextUnformatted(thread.thread_name.c_str());
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        ImGui::PushID(thread.thread_id);
+        ImGui::InvisibleButton("lane", ImVec2(width, (max_depth + 1) * row_height));
+        ImGui::PopID();
+        bool hovered = ImGui::IsItemHovered();
+        for (const ProfileZoneEvent &event : thread.events) {
+            if (event.end_ns < begin_ns || event.start_ns > end_ns) continue;
+            float x0 = origin.x + static_cast<float>((std::max(event.start_ns, begin_ns) - begin_ns) * px_per_ns);
+            float x1 = origin.x + static_cast<float>((std::min(event.end_ns, end_ns) - begin_ns) * px_per_ns);
+            // Short zones stay visible as a one pixel sliver
+            x1 = std::max(x1, x0 + 1.0f);
+            float y0 = origin.y + event.depth * row_height;
+            ImVec2 min(x0, y0);
+            ImVec2 max(x1, y0 + row_height - 1.0f);
+            draw_list->AddRectFilled(min, max, profiler_zone_color(event.name));
+            if (x1 - x0 > 24.0f) {
+                draw_list->PushClipRect(min, max, true);
+                draw_list->AddText(ImVec2(x0 + 2.0f, y0 + 2.0f), IM_COL32(0, 0, 0, 255), event.name);
+                draw_list->PopClipRect();
+            }
+            if (hovered && mouse.x >= min.x && mouse.x < max.x && mouse.y >= min.y && mouse.y < max.y) {
+                ImGui::SetTooltip("%s\n%.3f ms", event.name, static_cast<double>(event.end_ns - event.start_ns) / 1e6);
             }
         }
     }
+}
 
-    if (enemy.is_active) {
-        if (enemy.hp <= 0) enemy.death();
+auto _main_imgui_profiler() -> void {
+    ImGui::Begin("Profiler");
+    bool enabled = profiler_enabled();
+    if (ImGui::Checkbox("Enabled", &enabled)) set_profiler_enabled(enabled);
+    ImGui::SameLine();
+    ImGui::Checkbox("Paused", &global.profile_paused);
+    ImGui::SameLine();
+    if (ImGui::Button("Dump Chrome trace (F2)")) write_chrome_trace(Constants::trace_path);
+
+    // Frame times, oldest first, and their distribution in 2 ms buckets
+    constexpr int frame_count = static_cast<int>(std::tuple_size_v<decltype(global.frame_times_ms)>);
+    std::array<float, frame_count> frame_times;
+    std::array<float, 25> buckets{};
+    float worst_ms = 0.0f;
+    for (int i = 0; i < frame_count; ++i) {
+        float ms = global.frame_times_ms[(global.frame_counter + 1 + i) % frame_count];
+        frame_times[i] = ms;
+        buckets[std::min(static_cast<size_t>(ms / 2.0f), buckets.size() - 1)] += 1.0f;
+        worst_ms = std::max(worst_ms, ms);
     }
+    ImGui::PlotLines("##frame times", frame_times.data(), frame_count, 0, "frame time (ms)", 0.0f, std::max(worst_ms, 20.0f), ImVec2(0, 60));
+    ImGui::PlotHistogram("##frame histogram", buckets.data(), static_cast<int>(buckets.size()), 0,
+                         "frames per 2 ms bucket (last is 48+ ms)", 0.0f, FLT_MAX, ImVec2(0, 60));
+    ImGui::Text("Worst of the last %d frames: %.2f ms", frame_count, worst_ms);
+
+    ImGui::SliderFloat("Window (ms)", &global.profile_window_ms, 5.0f, 500.0f, "%.0f", ImGuiSliderFlags_Logarithmic);
+    int64_t window_ns = static_cast<int64_t>(global.profile_window_ms * 1e6f);
+    if (!global.profile_paused) {
+        global.profile_window_end_ns = profiler_now_ns();
+        profiler_collect(global.profile_window_end_ns - window_ns, global.profile_threads);
+    }
+    draw_profiler_timeline(global.profile_threads, global.profile_window_end_ns - window_ns, global.profile_window_end_ns);
+    ImGui::End();
 }
 
-auto shoot_at(Tower &tower, Position pos) -> void {
-    vec2 dir = pos - tower.box.get_center();
-    for (auto &proj : tower.projectiles) {
-        if (!proj.is_active) {
-            proj.box = Box{tower.box.get_center(), 0.02f, 0.02f};
-            proj.dir = glm::normalize(dir);
-            proj.is_active = true;
-            proj.spawn_time = global.frame_start_time;
+enum InspectorColumn : ImGuiID {
+    EnemyColumnSlot,
+    EnemyColumnId,
+    EnemyColumnX,
+    EnemyColumnY,
+    EnemyColumnProgress,
+    EnemyColumnHp,
+    EnemyColumnHpMax,
+    TowerColumnIndex,
+    TowerColumnType,
+    TowerColumnLevel,
+    TowerColumnTargeting,
+    TowerColumnActive,
+    TowerColumnInRange,
+    ProjectileColumnSlot,
+    ProjectileColumnX,
+    ProjectileColumnY,
+    ProjectileColumnTower,
+    ProjectileColumnDamage,
+};
 
-            tower.time_of_last_shot = global.frame_start_time;
-            return;
-        }
+constexpr ImGuiTableFlags inspector_table_flags = ImGuiTableFlags_Sortable | ImGuiTableFlags_SortMulti | ImGuiTableFlags_RowBg |
+                                                  ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+
+auto tower_type_name(TowerType type) -> const char * {
+    switch (type) {
+    case TowerType::Fire:
+        return "fire";
+    case TowerType::Ice:
+        return "ice";
+    case TowerType::Buff:
+        return "buff";
+    default:
+        return "?";
     }
 }
 
-auto proj_get_tower(const Projectile &proj) -> const Tower & {
-    return global.game.towers[proj.tower_idx];
+// Sorts `rows` (indices into a snapshot vector, which the first column of every table shows) by the sort specs
+// of the current table. `key(row, column)` is what a row sorts by in that column; rows equal in every sorted
+// column stay in index order. Sorted every frame, the rows come from a new snapshot every frame anyway.
+template <typename Key>
+auto inspector_sort(ArenaList<int> &rows, size_t row_count, Key &&key) -> void {
+    ImGuiTableSortSpecs *specs = ImGui::TableGetSortSpecs();
+    if (!specs || specs->SpecsCount == 0) return;
+    specs->SpecsDirty = false;
+    // Rows are collected in index order already
+    const ImGuiTableColumnSortSpecs *sorted_by = specs->Specs;
+    int spec_count = specs->SpecsCount;
+    if (spec_count == 1 && sorted_by[0].ColumnIndex == 0 && sorted_by[0].SortDirection == ImGuiSortDirection_Ascending) return;
+
+    // Keys computed once per row instead of once per comparison, descending ones negated
+    double *keys = global.frame_arena.allocate<double>(row_count * spec_count);
+    for (int row : rows) {
+        for (int i = 0; i < spec_count; ++i) {
+            double k = key(row, sorted_by[i].ColumnUserID);
+            keys[row * spec_count + i] = sorted_by[i].SortDirection == ImGuiSortDirection_Descending ? -k : k;
+        }
+    }
+    std::sort(rows.begin(), rows.end(), [&](int a, int b) {
+        for (int i = 0; i < spec_count; ++i) {
+            double key_a = keys[a * spec_count + i];
+            double key_b = keys[b * spec_count + i];
+            if (key_a != key_b) return key_a < key_b;
+        }
+        return a < b;
+    });
 }
 
-auto on_tick_projectile(Projectile &proj) -> void {
-    if (!proj.is_active) return;
+auto inspector_enemy_table(const RenderSnapshot &snapshot) -> void {
+    InspectorState &inspector = global.inspector;
+    ImGui::SetNextItemWidth(150.0f);
+    ImGui::SliderInt("HP below (%)", &inspector.hp_below_pct, 0, 100);
 
-    auto duration = std::chrono::duration<float>(global.frame_start_time - proj.spawn_time);
-    if (duration.count() >= 1.0f) {
-        proj.is_active = false;
-        return;
+    // Enemies in range of the filter tower, sorted for the lookups below
+    ArenaList<EnemyId> in_range(global.frame_arena);
+    if (inspector.tower_filter >= 0) {
+        for (const auto &target : snapshot.targets) {
+            if (target.tower_idx == inspector.tower_filter) in_range.push_back(target.enemy.id);
+        }
+        std::sort(in_range.begin(), in_range.end());
     }
-    proj.box.position += 0.01f * proj.dir;
-    for (auto &enemy : global.game.enemies) {
-        if (collision_box_box(proj.box, enemy.box)) {
-            const Tower &tower = proj_get_tower(proj);
-            enemy.take_damage(global.table_tower_damage[tower.level]);
-            proj.is_active = false;
-            break;
+    ArenaList<int> rows(global.frame_arena);
+    for (int i = 0; i < static_cast<int>(snapshot.enemies.size()); ++i) {
+        const auto &enemy = snapshot.enemies[i];
+        if (inspector.hp_below_pct < 100 && enemy.hp * 100 >= inspector.hp_below_pct * enemy.hp_max) continue;
+        if (inspector.tower_filter >= 0 && !std::binary_search(in_range.begin(), in_range.end(), enemy.id)) continue;
+        rows.push_back(i);
+    }
+    ImGui::Text("%zu of %zu enemies", rows.size(), snapshot.enemies.size());
+
+    if (!ImGui::BeginTable("enemies", 7, inspector_table_flags, ImVec2(0.0f, 300.0f))) return;
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Slot", ImGuiTableColumnFlags_DefaultSort, 0.0f, EnemyColumnSlot);
+    ImGui::TableSetupColumn("Id", 0, 0.0f, EnemyColumnId);
+    ImGui::TableSetupColumn("X", 0, 0.0f, EnemyColumnX);
+    ImGui::TableSetupColumn("Y", 0, 0.0f, EnemyColumnY);
+    ImGui::TableSetupColumn("Progress", 0, 0.0f, EnemyColumnProgress);
+    ImGui::TableSetupColumn("HP", 0, 0.0f, EnemyColumnHp);
+    ImGui::TableSetupColumn("Max HP", 0, 0.0f, EnemyColumnHpMax);
+    ImGui::TableHeadersRow();
+    inspector_sort(rows, snapshot.enemies.size(), [&](int row, ImGuiID column) -> double {
+        const auto &enemy = snapshot.enemies[row];
+        switch (column) {
+        case EnemyColumnX:
+            return enemy.box.position.x;
+        case EnemyColumnY:
+            return enemy.box.position.y;
+        case EnemyColumnProgress:
+            return enemy.progress;
+        case EnemyColumnHp:
+            return enemy.hp;
+        case EnemyColumnHpMax:
+            return enemy.hp_max;
+        case EnemyColumnId:
+            return enemy.id;
+        default:
+            return row;
+        }
+    });
+
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(rows.size()));
+    while (clipper.Step()) {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+            const auto &enemy = snapshot.enemies[rows[row]];
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            char label[16];
+            std::snprintf(label, sizeof(label), "%d", rows[row]);
+            bool highlighted = inspector.highlighted_enemy == enemy.id;
+            if (ImGui::Selectable(label, highlighted, ImGuiSelectableFlags_SpanAllColumns)) {
+                inspector.highlighted_enemy = highlighted ? std::nullopt : std::optional<EnemyId>(enemy.id);
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", enemy.id);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", enemy.box.position.x);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", enemy.box.position.y);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", enemy.progress);
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", enemy.hp);
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", enemy.hp_max);
         }
     }
+    ImGui::EndTable();
 }
 
-auto on_tick_tower(Tower &tower) -> void {
-    if (!tower.is_active) return;
-    tower.enemies_in_range.clear();
-
-    for (size_t enemy_idx = 0; enemy_idx < global.game.enemies.size(); ++enemy_idx) {
-        auto &enemy = global.game.enemies[enemy_idx];
-        if (!enemy.is_active) continue;
-        float dist = distance(tower.box, enemy.box);
-        if (dist < global.table_tower_range[tower.level]) {
-            tower.enemies_in_range.push_back(EnemyInRange{
-                static_cast<int>(enemy_idx), dist});
-        }
-    }
+auto inspector_tower_table(const RenderSnapshot &snapshot) -> void {
+    InspectorState &inspector = global.inspector;
+    ImGui::Checkbox("Active only", &inspector.active_towers_only);
 
-    auto tower_firing_delay = std::chrono::duration<float>(global.table_tower_firing_delay[tower.level]);
-    bool ready_to_shoot = (global.frame_start_time - tower.time_of_last_shot) > tower_firing_delay;
-    if (ready_to_shoot) {
-        if (auto closest = tower.find_closest_enemy()) {
-            Enemy enemy = global.game.enemies[*closest];
-            shoot_at(tower, enemy.box.get_center());
-        }
+    int tower_count = static_cast<int>(snapshot.towers.size());
+    int *in_range_counts = global.frame_arena.allocate<int>(tower_count);
+    std::fill(in_range_counts, in_range_counts + tower_count, 0);
+    for (const auto &target : snapshot.targets) {
+        in_range_counts[target.tower_idx] += 1;
     }
-    for (auto &proj : tower.projectiles) {
-        on_tick_projectile(proj);
+    ArenaList<int> rows(global.frame_arena);
+    for (int i = 0; i < tower_count; ++i) {
+        if (inspector.active_towers_only && !snapshot.towers[i].is_active) continue;
+        rows.push_back(i);
     }
+    ImGui::Text("%zu of %d towers", rows.size(), tower_count);
+
+    if (!ImGui::BeginTable("towers", 6, inspector_table_flags, ImVec2(0.0f, 300.0f))) return;
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Index", ImGuiTableColumnFlags_DefaultSort, 0.0f, TowerColumnIndex);
+    ImGui::TableSetupColumn("Type", 0, 0.0f, TowerColumnType);
+    ImGui::TableSetupColumn("Level", 0, 0.0f, TowerColumnLevel);
+    ImGui::TableSetupColumn("Targeting", 0, 0.0f, TowerColumnTargeting);
+    ImGui::TableSetupColumn("Active", 0, 0.0f, TowerColumnActive);
+    ImGui::TableSetupColumn("In range", 0, 0.0f, TowerColumnInRange);
+    ImGui::TableHeadersRow();
+    inspector_sort(rows, snapshot.towers.size(), [&](int row, ImGuiID column) -> double {
+        const auto &tower = snapshot.towers[row];
+        switch (column) {
+        case TowerColumnType:
+            return static_cast<double>(tower.type);
+        case TowerColumnLevel:
+            return tower.level;
+        case TowerColumnTargeting:
+            return static_cast<double>(tower.targeting);
+        case TowerColumnActive:
+            return tower.is_active;
+        case TowerColumnInRange:
+            return in_range_counts[row];
+        default:
+            return row;
+        }
+    });
+
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(rows.size()));
+    while (clipper.Step()) {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+            int tower_idx = rows[row];
+            const auto &tower = snapshot.towers[tower_idx];
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            char label[16];
+            std::snprintf(label, sizeof(label), "%d", tower_idx);
+            bool highlighted = inspector.highlighted_tower == tower_idx;
+            if (ImGui::Selectable(label, highlighted, ImGuiSelectableFlags_SpanAllColumns)) {
+                inspector.highlighted_tower = highlighted ? -1 : tower_idx;
+            }
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(tower_type_name(tower.type));
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", tower.level);
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(targeting_policy_name(tower.targeting));
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(tower.is_active ? "yes" : "no");
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", in_range_counts[tower_idx]);
+        }
+    }
+    ImGui::EndTable();
 }
 
-auto handle_gl_error(const char *reason) -> void {
-    std::cerr << reason << "\n"
-              << global.gl_error_buffer << "\n";
-    panic("GL Error");
-}
-
-auto format_time(std::chrono::system_clock::time_point tp) -> const char * {
-    static char buffer[64];
-
-    std::time_t time = std::chrono::system_clock::to_time_t(tp);
-    std::tm *tm_ptr = std::localtime(&time);
-
-    std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", tm_ptr);
-    return buffer;
+auto inspector_projectile_table(const RenderSnapshot &snapshot) -> void {
+    InspectorState &inspector = global.inspector;
+    ArenaList<int> rows(global.frame_arena);
+    for (int i = 0; i < static_cast<int>(snapshot.projectiles.size()); ++i) {
+        if (inspector.tower_filter >= 0 && snapshot.projectiles[i].tower_idx != inspector.tower_filter) continue;
+        rows.push_back(i);
+    }
+    // Projectiles have no stable id, a click highlights the tower that fired them instead
+    ImGui::Text("%zu of %zu projectiles, click one to highlight its tower", rows.size(), snapshot.projectiles.size());
+
+    if (!ImGui::BeginTable("projectiles", 5, inspector_table_flags, ImVec2(0.0f, 300.0f))) return;
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Slot", ImGuiTableColumnFlags_DefaultSort, 0.0f, ProjectileColumnSlot);
+    ImGui::TableSetupColumn("X", 0, 0.0f, ProjectileColumnX);
+    ImGui::TableSetupColumn("Y", 0, 0.0f, ProjectileColumnY);
+    ImGui::TableSetupColumn("Tower", 0, 0.0f, ProjectileColumnTower);
+    ImGui::TableSetupColumn("Damage", 0, 0.0f, ProjectileColumnDamage);
+    ImGui::TableHeadersRow();
+    inspector_sort(rows, snapshot.projectiles.size(), [&](int row, ImGuiID column) -> double {
+        const auto &projectile = snapshot.projectiles[row];
+        switch (column) {
+        case ProjectileColumnX:
+            return projectile.box.position.x;
+        case ProjectileColumnY:
+            return projectile.box.position.y;
+        case ProjectileColumnTower:
+            return projectile.tower_idx;
+        case ProjectileColumnDamage:
+            return projectile.damage;
+        default:
+            return row;
+        }
+    });
+
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(rows.size()));
+    while (clipper.Step()) {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+            const auto &projectile = snapshot.projectiles[rows[row]];
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            char label[16];
+            std::snprintf(label, sizeof(label), "%d", rows[row]);
+            if (ImGui::Selectable(label, inspector.highlighted_tower == projectile.tower_idx, ImGuiSelectableFlags_SpanAllColumns)) {
+                inspector.highlighted_tower = projectile.tower_idx;
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", projectile.box.position.x);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", projectile.box.position.y);
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", projectile.tower_idx);
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", projectile.damage);
+        }
+    }
+    ImGui::EndTable();
 }
 
-auto format_duration(std::chrono::duration<float> duration) -> const char * {
-    static char buffer[32];
-    auto total_ms = static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
-
-    auto hrs = total_ms / (60 * 60 * 1000);
-    total_ms %= (60 * 60 * 1000);
-    auto mins = total_ms / (60 * 1000);
-    total_ms %= (60 * 1000);
-    auto secs = total_ms / 1000;
-    auto millis = total_ms % 1000;
-
-    std::snprintf(
-        buffer, sizeof(buffer),
-        "%02lld:%02lld:%02lld.%03lld",
-        hrs, mins, secs, millis);
-
-    return buffer;
+// Enemy, tower and projectile tables, only the open tab does any work.
+auto _main_imgui_inspector(const RenderSnapshot &snapshot) -> void {
+    InspectorState &inspector = global.inspector;
+    int last_tower = static_cast<int>(snapshot.towers.size()) - 1;
+    inspector.tower_filter = std::min(inspector.tower_filter, last_tower);
+    ImGui::SetNextItemWidth(150.0f);
+    ImGui::SliderInt("Tower filter (-1: all)", &inspector.tower_filter, -1, last_tower);
+    ImGui::SameLine();
+    if (ImGui::Button("Clear highlight")) {
+        inspector.highlighted_enemy.reset();
+        inspector.highlighted_tower = -1;
+    }
+    if (!ImGui::BeginTabBar("inspector")) return;
+    if (ImGui::BeginTabItem("Enemies")) {
+        inspector_enemy_table(snapshot);
+        ImGui::EndTabItem();
+    }
+    if (ImGui::BeginTabItem("Towers")) {
+        inspector_tower_table(snapshot);
+        ImGui::EndTabItem();
+    }
+    if (ImGui::BeginTabItem("Projectiles")) {
+        inspector_projectile_table(snapshot);
+        ImGui::EndTabItem();
+    }
+    ImGui::EndTabBar();
 }
 
 auto _main_imgui() -> void {
+    TD_PROFILE_ZONE("_main_imgui");
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplSDL2_NewFrame(global.window);
     ImGui::NewFrame();
@@ -667,25 +1455,47 @@ auto _main_imgui() -> void {
         ImGui::Text("Frame Counter: %d", global.frame_counter);
         ImGui::Text("Runtime: %s", format_duration(global.runtime));
         ImGui::Text("Delta Time (ms): %f", global.delta_time.count());
-        ImGui::Text("Score: %d", global.game.score);
-        ImGui::Text("Life: %d", global.game.life);
-        ImGui::Text("Mouse Position: (%.3f, %.3f)", global.mouse_pos.x, global.mouse_pos.y);
-        for (size_t enemy_idx = 0; enemy_idx < global.game.enemies.size(); ++enemy_idx) {
-            auto enemy = global.game.enemies[enemy_idx];
-            ImGui::Text("Enemy %zu (%.3f, %.3f) target: %d", enemy_idx, enemy.box.position.x, enemy.box.position.y, enemy.pathfinding_target);
-        }
-        for (size_t tower_idx = 0; tower_idx < global.game.towers.size(); ++tower_idx) {
-            auto &tower = global.game.towers[tower_idx];
-            for (auto &eir : tower.enemies_in_range) {
-                ImGui::Text("Tower %zu -> Enemy %d (dist=%.3f)", tower_idx, eir.id, eir.distance);
+        const RenderSnapshot &snapshot = global.sim_thread.front_snapshot();
+        ImGui::Text("Sim Tick: %lld @ %d Hz (%s)", snapshot.tick, snapshot.tick_rate, global.sim_thread.pipelined ? "pipelined" : "inline");
+        ImGui::Text("Ticks This Frame: %d (dropped total: %lld)", snapshot.ticks_this_frame, snapshot.dropped_ticks);
+        ImGui::Text("Render Alpha: %.3f", snapshot.alpha);
+        ImGui::Text("Heap: %llu allocations (%llu bytes) last frame, worst %llu", static_cast<unsigned long long>(global.last_frame_allocations.allocations),
+                    static_cast<unsigned long long>(global.last_frame_allocations.bytes), static_cast<unsigned long long>(global.worst_frame_allocations));
+        ImGui::Text("Frame arena: %zu of %zu KB last frame, high water %zu KB, grew %d times", global.frame_arena.last_frame_bytes / 1024,
+                    global.frame_arena.bytes_capacity() / 1024, global.frame_arena.high_water / 1024, global.frame_arena.grows);
+        ImGui::Text("Streamed: %zu bytes/frame (%s, %lld stalls, %d grows)", global.instance_stream.bytes_last_frame,
+                    global.instance_stream.persistent ? "persistent" : "map range", global.instance_stream.stalls, global.instance_stream.grows);
+        if (global.gpu_timer.supported) {
+            const GpuPassTimer &timer = global.gpu_timer;
+            ImGui::Text("GPU passes (ms, average / last, %d frames behind, %lld skipped):", GpuPassTimer::latency, timer.skipped);
+            for (int pass = 0; pass < GpuPassTimer::NumPass; ++pass) {
+                ImGui::Text("  %s: %.3f / %.3f", GpuPassTimer::pass_names[pass], timer.average_ms[pass], timer.last_ms[pass]);
             }
+        } else {
+            ImGui::Text("GPU passes: no timestamp queries on this context");
+        }
+        if (global.capture.created) {
+            const FrameCapture &capture = global.capture;
+            ImGui::Text("Capture%s: %lld read, %lld written, %lld dropped, %lld stalls, %lld failed", capture.active ? "" : " (paused)",
+                        capture.frames_read, capture.frames_written.load(), capture.frames_dropped, capture.stalls, capture.write_failures.load());
         }
+        ImGui::Text("Score: %d", snapshot.score);
+        ImGui::Text("Life: %d", snapshot.life);
+        ImGui::Text("Mouse Position: (%.3f, %.3f)", global.mouse_pos.x, global.mouse_pos.y);
+        ImGui::Separator();
+        _main_imgui_inspector(snapshot);
         ImGui::End();
     } // Debug
+    _main_imgui_profiler();
     ImGui::Render();
 }
 
+auto push_input(const InputCommand &input) -> void {
+    if (!global.sim_thread.inputs.push(input)) std::cerr << "Input queue full, dropping input\n";
+}
+
 auto _main_handle_inputs() -> void {
+    TD_PROFILE_ZONE("_main_handle_inputs");
     int mouse_x, mouse_y;
     SDL_GetMouseState(&mouse_x, &mouse_y);
     global.mouse_pos = Position{
@@ -705,8 +1515,28 @@ auto _main_handle_inputs() -> void {
                 global.running = false;
                 break;
             case SDLK_e:
-                Position mouse_pos_ndc = window_normalized_to_ndc(global.mouse_pos);
-                spawn_enemy_at_position(mouse_pos_ndc);
+                push_input(InputCommand{InputType::SpawnEnemy, window_normalized_to_ndc(global.mouse_pos)});
+                break;
+            case SDLK_t:
+                push_input(InputCommand{InputType::CycleTargetingAt, window_normalized_to_ndc(global.mouse_pos)});
+                break;
+            case SDLK_F2:
+                write_chrome_trace(Constants::trace_path);
+                break;
+            case SDLK_F3:
+                if (!global.capture.created) {
+                    global.capture.create(Constants::capture_dir, FrameCapture::Format::Png, default_capture_writers());
+                }
+                global.capture.active = global.capture.created && !global.capture.active;
+                break;
+            case SDLK_F5:
+                global.sim_thread.save_requested = true;
+                break;
+            case SDLK_F6:
+                global.sim_thread.export_requested = true;
+                break;
+            case SDLK_F9:
+                global.sim_thread.load_requested = true;
                 break;
             }
         }
@@ -714,138 +1544,150 @@ auto _main_handle_inputs() -> void {
         if (event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_LEFT) {
             auto mouse_pos = Position{global.mouse_pos.x, global.mouse_pos.y};
             std::cout << "Mouse Clicked at: " << mouse_pos << "\n";
-            spawn_tower_at_position(
-                window_normalized_to_ndc(mouse_pos) - vec2{0.05f, -0.05f});
+            push_input(InputCommand{InputType::SpawnTower, window_normalized_to_ndc(mouse_pos) - vec2{0.05f, -0.05f}});
         }
         if (event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_RIGHT) {
             Position mouse_pos_ndc = window_normalized_to_ndc(global.mouse_pos);
-            for (auto &tower : global.game.towers) {
-                if (tower.box.is_point_inside(mouse_pos_ndc)) {
-                    std::cout << "Disabling tower\n";
-                    tower.is_active = false;
-                }
-            }
+            std::cout << "Disabling towers at: " << global.mouse_pos << "\n";
+            push_input(InputCommand{InputType::DisableTowerAt, mouse_pos_ndc});
         }
     }
 }
 
 namespace gl {
-auto set_box_ubo(ShaderProgram sp, const Box box) -> void {
-    glUniform2f(sp.ubos["u_Pos"], box.position.x, box.position.y);
-    glUniform1f(sp.ubos["u_Width"], box.width);
-    glUniform1f(sp.ubos["u_Height"], box.height);
-}
-auto set_color_ubo(ShaderProgram sp, const Color color) -> void {
-    glUniform3f(sp.ubos["u_Color"], color.r, color.g, color.b);
-}
-auto draw_square() -> void {
-    glDrawElements(GL_TRIANGLES, Constants::square_indices.size(), GL_UNSIGNED_INT, 0);
+// Enables the per-instance attributes on the currently bound VAO, `draw_shapes` points them at the data.
+auto add_instance_attributes() -> void {
+    for (GLuint location = 1; location <= 5; ++location) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
 }
-auto draw_triangle() -> void {
-    glDrawElements(GL_TRIANGLES, Constants::triangle_indices.size(), GL_UNSIGNED_INT, 0);
+// `box` is the bounding box of the shape, a circle fills the largest circle centered in it.
+auto push_shape(ShapeLayer layer, uint32_t shape, const Box &box, const Color &color, float alpha = 1.0f, float outline = 0.0f) -> void {
+    global.instances.push_back(InstanceData{box.position.x, box.position.y, box.width, box.height, color.r, color.g, color.b, alpha, outline, shape});
+    global.instance_layers.push_back(layer);
 }
-auto draw_circle() -> void {
-    glDrawElements(GL_TRIANGLES, Constants::circle_indices.size(), GL_UNSIGNED_INT, 0);
+/*
+Sorts the pushed instances by layer (a counting sort, stable within a layer, so instances of one layer draw in
+the order they were pushed) and draws all of them with one call. Every shape shares the unit quad and the
+shape program, so there is no program or VAO switch between layers and blending just follows the order.
+*/
+auto draw_shapes() -> void {
+    size_t count = global.instances.size();
+    if (count == 0) return;
+    std::array<size_t, NumLayers + 1> starts{};
+    for (uint8_t layer : global.instance_layers) {
+        starts[layer + 1] += 1;
+    }
+    for (int layer = 0; layer < NumLayers; ++layer) {
+        starts[layer + 1] += starts[layer];
+    }
+    InstanceData *sorted = global.frame_arena.allocate<InstanceData>(count);
+    for (size_t idx = 0; idx < count; ++idx) {
+        sorted[starts[global.instance_layers[idx]]++] = global.instances[idx];
+    }
+
+    size_t offset = global.instance_stream.write(sorted, count * sizeof(InstanceData));
+    // GL 4.1 has no base instance, so the attribute pointers carry the offset of this batch instead
+    glBindBuffer(GL_ARRAY_BUFFER, global.instance_stream.vbo);
+    constexpr GLsizei stride = sizeof(InstanceData);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)(offset + offsetof(InstanceData, x)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void *)(offset + offsetof(InstanceData, width)));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void *)(offset + offsetof(InstanceData, r)));
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, stride, (void *)(offset + offsetof(InstanceData, outline)));
+    glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, stride, (void *)(offset + offsetof(InstanceData, shape)));
+    glDrawElementsInstanced(GL_TRIANGLES, Constants::square_indices.size(), GL_UNSIGNED_INT, 0, count);
+    global.instances.clear();
+    global.instance_layers.clear();
 }
 } // namespace gl
 
+// Outlines whatever the inspector highlights, in the topmost opaque layer.
+auto push_inspector_highlight(const RenderSnapshot &snapshot) -> void {
+    auto outline = [](const Box &box) {
+        // The outline is centered on the edge, so half of it overhangs the box
+        constexpr float t = 0.01f;
+        gl::push_shape(LayerHighlight, ShapeRect, box, global.color.highlight, 1.0f, t);
+    };
+    const InspectorState &inspector = global.inspector;
+    if (inspector.highlighted_enemy) {
+        for (const auto &enemy : snapshot.enemies) {
+            if (enemy.id == *inspector.highlighted_enemy) outline(enemy.box);
+        }
+    }
+    if (inspector.highlighted_tower >= 0 && inspector.highlighted_tower < static_cast<int>(snapshot.towers.size())) {
+        outline(snapshot.towers[inspector.highlighted_tower].box);
+    }
+}
+
 auto _main_render() -> void {
+    TD_PROFILE_ZONE("_main_render");
     glViewport(0, 0, (int)global.imgui_io.DisplaySize.x, (int)global.imgui_io.DisplaySize.y);
     glClearColor(global.color.background.r, global.color.background.g, global.color.background.b, 1.0f);
+    global.gpu_timer.begin_frame();
+    global.capture.begin_frame();
     glClear(GL_COLOR_BUFFER_BIT);
+    global.gpu_timer.end_pass(GpuPassTimer::Clear);
+    global.instance_stream.begin_frame();
+    const RenderSnapshot &snapshot = global.sim_thread.front_snapshot();
+
+    { // Frame uniforms, shared by all programs
+        FrameUniforms frame{static_cast<float>(global.runtime.count()), Constants::aspect_ratio};
+        glBindBuffer(GL_UNIFORM_BUFFER, global.frame_ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+        glBindBuffer(GL_UNIFORM_BUFFER, GL_ZERO);
+    }
 
-    { // Single Color Shader Program
-        ShaderProgram &shader = global.shader_program_single_color;
-        shader.activate();
-        glUniform1f(shader.ubos["u_Time"], static_cast<float>(global.runtime.count()));
-        // shader.set_ubo1f("u_Time", static_cast<float>(global.runtime.count()));
-
-        { // Triangle VAO
-            glBindVertexArray(global.vao_triangle);
-            for (size_t tower_idx = 0; tower_idx < global.game.towers.size(); ++tower_idx) {
-                Tower &tower = global.game.towers[tower_idx];
-                if (!tower.is_active) continue;
-
-                switch (tower.type) {
-                case TowerType::Fire:
-                    gl::set_color_ubo(global.shader_program_single_color, global.color.tower_fire);
-                    break;
-                case TowerType::Ice:
-                    gl::set_color_ubo(global.shader_program_single_color, global.color.tower_ice);
-                    break;
-                case TowerType::Buff:
-                    gl::set_color_ubo(global.shader_program_single_color, global.color.tower_buff);
-                    break;
-                default:
-                    panic("Unknown Tower Type!");
-                    break;
-                }
-                gl::set_box_ubo(shader, tower.box);
-
-                gl::draw_triangle();
-            }
-            glBindVertexArray(global.vao_NONE);
-        } // Triangle VAO
-
-        { // Square VAO
-            glBindVertexArray(global.vao_square);
-            gl::set_color_ubo(shader, global.color.path_marker);
-            for (size_t marker_idx = 0; marker_idx < global.path_markers.size(); ++marker_idx) {
-                gl::set_box_ubo(shader, global.path_markers[marker_idx]);
-                gl::draw_square();
-            }
-
-            for (size_t enemy_idx = 0; enemy_idx < global.game.enemies.size(); ++enemy_idx) {
-                Enemy &enemy = global.game.enemies[enemy_idx];
-                if (!enemy.is_active) continue;
-
-                float health_pct = static_cast<float>(enemy.hp) / enemy.hp_max;
-                gl::set_color_ubo(shader, Color::mix(Constants::Color::black, global.color.enemy, health_pct));
-                gl::set_box_ubo(shader, enemy.box);
-                gl::draw_square();
-            }
-
-            gl::set_color_ubo(shader, global.color.projectile);
-            for (auto &tower : global.game.towers) {
-                if (!tower.is_active) continue;
-                for (auto &proj : tower.projectiles) {
-                    if (!proj.is_active) continue;
-                    gl::set_box_ubo(shader, proj.box);
-                    gl::draw_square();
-                }
-            }
-            glBindVertexArray(global.vao_NONE);
-        } // Square VAO
-    }
-    { // Tower Range Shader Program
-        ShaderProgram &shader = global.shader_program_tower_range;
-        shader.activate();
-        glUniform1f(shader.ubos["u_Time"], static_cast<float>(global.runtime.count()));
-
-        { // Circle VAO
-            glBindVertexArray(global.vao_circle);
-            for (size_t tower_idx = 0; tower_idx < global.game.towers.size(); ++tower_idx) {
-                Tower &tower = global.game.towers[tower_idx];
-                if (!tower.is_active) continue;
-
-                gl::set_color_ubo(shader, global.color.tower_radius);
-
-                float tower_range = global.table_tower_range[tower.level];
-                auto box_shifted = Box{tower.box.get_center(), tower_range, tower_range};
-                gl::set_box_ubo(shader, box_shifted);
-                glUniform1f(shader.ubos["u_Radius"], tower_range);
-                glUniform2f(shader.ubos["u_Pos"], tower.box.get_center().x, tower.box.get_center().y);
-                gl::draw_circle();
-            }
-            glBindVertexArray(global.vao_NONE);
-        } // Circle VAO
+    for (const auto &tower : snapshot.towers) {
+        if (!tower.is_active) continue;
+        Color color;
+        switch (tower.type) {
+        case TowerType::Fire:
+            color = global.color.tower_fire;
+            break;
+        case TowerType::Ice:
+            color = global.color.tower_ice;
+            break;
+        case TowerType::Buff:
+            color = global.color.tower_buff;
+            break;
+        default:
+            panic("Unknown Tower Type!");
+            break;
+        }
+        gl::push_shape(LayerTowers, ShapeTriangle, tower.box, color);
+        // The range ring is centered on the tower, its bounding box spans the range in every direction
+        Position center = tower.box.get_center();
+        Box range_box{Position{center.x - tower.range, center.y + tower.range}, 2.0f * tower.range, 2.0f * tower.range};
+        gl::push_shape(LayerRanges, ShapeCircle | ShapeRange, range_box, global.color.tower_radius, global.color.tower_radius_alpha);
+    }
+    for (const Box &marker : snapshot.path_markers) {
+        gl::push_shape(LayerMarkers, ShapeRect, marker, global.color.path_marker);
+    }
+    for (const auto &enemy : snapshot.enemies) {
+        gl::push_shape(LayerEnemies, ShapeRect, enemy.box, Color::mix(Constants::Color::black, global.color.enemy, enemy.health_pct));
+    }
+    for (const auto &proj : snapshot.projectiles) {
+        gl::push_shape(LayerProjectiles, ShapeRect, proj.box, global.color.projectile);
     }
+    push_inspector_highlight(snapshot);
+
+    global.shader_program_shapes.activate();
+    glBindVertexArray(global.vao_square);
+    gl::draw_shapes();
+    glBindVertexArray(global.vao_NONE);
+    global.gpu_timer.end_pass(GpuPassTimer::Shapes);
+    global.instance_stream.end_frame();
+    global.capture.end_frame();
+    global.gpu_timer.end_pass(GpuPassTimer::Capture);
 }
 
 /*
 Handles the SDL, ImGUI, OpenGL init and linking. Returns true if setup successful, false otherwise
 */
 auto setup() -> bool {
+    // The offscreen driver renders through EGL without a display server, for CI
+    if (global.offscreen) SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
     // Initialize SDL2 with video and timer subsystems
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0) {
         std::cerr << "Error: SDL_Init failed: " << SDL_GetError() << "\n";
@@ -862,7 +1704,7 @@ auto setup() -> bool {
         Constants::window_title.data(),
         SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
         Constants::window_width, Constants::window_height,
-        SDL_WINDOW_OPENGL);
+        SDL_WINDOW_OPENGL | (global.offscreen ? SDL_WINDOW_HIDDEN : 0));
     if (!global.window) {
         std::cerr << "Error: SDL_CreateWindow failed: " << SDL_GetError() << "\n";
         SDL_Quit();
@@ -930,78 +1772,60 @@ auto compile_shader_from_file(const char *filepath, GLenum shader_type) -> gl_Sh
     return shader;
 }
 
-auto compile_shader_program_single_color() -> void {
-    gl_Shader vertex_shader = compile_shader_from_file(Constants::fp_vertex_shader, GL_VERTEX_SHADER);
+auto link_shader_program(const char *fp_vertex, const char *fp_fragment) -> ShaderProgram {
+    gl_Shader vertex_shader = compile_shader_from_file(fp_vertex, GL_VERTEX_SHADER);
     if (vertex_shader == 0) panic("Failed to compile vertex shader.");
-    gl_Shader fragment_shader = compile_shader_from_file(Constants::fp_fragment_shader, GL_FRAGMENT_SHADER);
+    gl_Shader fragment_shader = compile_shader_from_file(fp_fragment, GL_FRAGMENT_SHADER);
     if (fragment_shader == 0) panic("Failed to compile fragment shader.");
 
-    global.shader_program_single_color.id = glCreateProgram();
+    ShaderProgram program;
+    program.id = glCreateProgram();
 
-    glAttachShader(global.shader_program_single_color.id, vertex_shader);
-    glAttachShader(global.shader_program_single_color.id, fragment_shader);
+    glAttachShader(program.id, vertex_shader);
+    glAttachShader(program.id, fragment_shader);
 
-    glLinkProgram(global.shader_program_single_color.id);
-    glGetProgramiv(global.shader_program_single_color.id, GL_LINK_STATUS, &global.gl_success);
+    glLinkProgram(program.id);
+    glGetProgramiv(program.id, GL_LINK_STATUS, &global.gl_success);
     if (!global.gl_success) {
-        glGetProgramInfoLog(global.shader_program_single_color.id, 512, nullptr, global.gl_error_buffer);
+        glGetProgramInfoLog(program.id, 512, nullptr, global.gl_error_buffer);
         panic(std::string("Shader Program Link Failed: ") + global.gl_error_buffer);
     }
 
-    global.shader_program_single_color.activate();
-
     glDeleteShader(vertex_shader);
     glDeleteShader(fragment_shader);
 
-    std::vector<std::string> uniformNames = {
-        "u_Time",
-        "u_Pos",
-        "u_Width",
-        "u_Height",
-        "u_Color",
-        "u_AspectRatio"};
-
-    for (const std::string &name : uniformNames) {
-        global.shader_program_single_color.ubos[name] = glGetUniformLocation(global.shader_program_single_color.id, name.c_str());
+    GLint uniform_count = 0;
+    glGetProgramiv(program.id, GL_ACTIVE_UNIFORMS, &uniform_count);
+    for (GLuint uniform_idx = 0; uniform_idx < static_cast<GLuint>(uniform_count); ++uniform_idx) {
+        GLint block_idx;
+        glGetActiveUniformsiv(program.id, 1, &uniform_idx, GL_UNIFORM_BLOCK_INDEX, &block_idx);
+        if (block_idx != -1) continue;
+
+        char name[128];
+        GLsizei name_length;
+        GLint array_size;
+        GLenum type;
+        glGetActiveUniform(program.id, uniform_idx, sizeof(name), &name_length, &array_size, &type, name);
+        program.uniforms.push_back(ShaderProgram::UniformInfo{std::string(name, name_length), glGetUniformLocation(program.id, name), type});
     }
-    glUniform1f(global.shader_program_single_color.ubos["u_AspectRatio"], Constants::aspect_ratio);
-}
-auto compile_shader_program_tower_radius() -> void {
-    gl_Shader vertex_shader = compile_shader_from_file(Constants::fp_vertex_shader, GL_VERTEX_SHADER);
-    if (vertex_shader == 0) panic("Failed to compile vertex shader.");
-    gl_Shader fragment_shader = compile_shader_from_file(Constants::fp_fragment_tower_range_shader, GL_FRAGMENT_SHADER);
-    if (fragment_shader == 0) panic("Failed to compile fragment shader.");
-
-    global.shader_program_tower_range.id = glCreateProgram();
 
-    glAttachShader(global.shader_program_tower_range.id, vertex_shader);
-    glAttachShader(global.shader_program_tower_range.id, fragment_shader);
-
-    glLinkProgram(global.shader_program_tower_range.id);
-    glGetProgramiv(global.shader_program_tower_range.id, GL_LINK_STATUS, &global.gl_success);
-    if (!global.gl_success) {
-        glGetProgramInfoLog(global.shader_program_tower_range.id, 512, nullptr, global.gl_error_buffer);
-        panic(std::string("Shader Program Link Failed: ") + global.gl_error_buffer);
+    GLuint frame_block = glGetUniformBlockIndex(program.id, "FrameUniforms");
+    if (frame_block != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program.id, frame_block, Constants::frame_uniforms_binding);
     }
+    return program;
+}
 
-    global.shader_program_tower_range.activate();
-
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
-
-    std::vector<std::string> uniformNames = {
-        "u_Time",
-        "u_Pos",
-        "u_Width",
-        "u_Height",
-        "u_Color",
-        "u_Radius",
-        "u_AspectRatio"};
+auto compile_shader_program_shapes() -> void {
+    global.shader_program_shapes = link_shader_program(Constants::fp_shape_vertex_shader, Constants::fp_shape_fragment_shader);
+}
 
-    for (const std::string &name : uniformNames) {
-        global.shader_program_tower_range.ubos[name] = glGetUniformLocation(global.shader_program_tower_range.id, name.c_str());
-    }
-    glUniform1f(global.shader_program_tower_range.ubos["u_AspectRatio"], Constants::aspect_ratio);
+auto create_frame_ubo() -> void {
+    glGenBuffers(1, &global.frame_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, global.frame_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, Constants::frame_uniforms_binding, global.frame_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, GL_ZERO);
 }
 
 auto create_vao_square() -> void {
@@ -1034,84 +1858,21 @@ auto create_vao_square() -> void {
         Constants::square_indices.data(),
         GL_STATIC_DRAW);
 
-    glBindVertexArray(global.vao_NONE);
-}
-
-auto create_vao_triangle() -> void {
-    // 1) Generate and bind the VAO up front
-    glGenVertexArrays(1, &global.vao_circle);
-    glBindVertexArray(global.vao_circle);
-
-    // 2) Create VBO, upload vertex data, set attribute pointers
-    gl_VBO vbo;
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(
-        GL_ARRAY_BUFFER,
-        sizeof(Constants::circle_vertices),
-        Constants::circle_vertices.data(),
-        GL_STATIC_DRAW);
-    glVertexAttribPointer(
-        0, // location = 0 in your vertex shader
-        3, // 3 floats per vertex (x, y, z)
-        GL_FLOAT,
-        GL_FALSE,
-        3 * sizeof(float), // stride
-        (void *)0          // offset
-    );
-    glEnableVertexAttribArray(0);
-
-    // 3) Create EBO *while the VAO is still bound*, so the binding is stored in it
-    gl_EBO ebo;
-    glGenBuffers(1, &ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(
-        GL_ELEMENT_ARRAY_BUFFER,
-        sizeof(Constants::circle_indices),
-        Constants::circle_indices.data(),
-        GL_STATIC_DRAW);
-
-    glBindVertexArray(global.vao_NONE);
-}
-
-auto creat_vao_triangle() -> void {
-    // 1) Generate and bind the VAO for the triangle
-    glGenVertexArrays(1, &global.vao_triangle);
-    glBindVertexArray(global.vao_triangle);
-
-    // 2) Create VBO, upload triangle vertex data, set attribute pointers
-    gl_VBO triangle_vbo;
-    glGenBuffers(1, &triangle_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, triangle_vbo);
-    glBufferData(
-        GL_ARRAY_BUFFER,
-        sizeof(Constants::triangle_vertices),
-        Constants::triangle_vertices.data(),
-        GL_STATIC_DRAW);
-    glVertexAttribPointer(
-        0, // location = 0 in your vertex shader
-        3, // 3 floats per vertex (x, y, z)
-        GL_FLOAT,
-        GL_FALSE,
-        3 * sizeof(float), // stride
-        (void *)0          // offset
-    );
-    glEnableVertexAttribArray(0);
-
-    // 3) Create EBO while VAO is still bound, so the binding is stored in it
-    gl_EBO triangle_ebo;
-    glGenBuffers(1, &triangle_ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, triangle_ebo);
-    glBufferData(
-        GL_ELEMENT_ARRAY_BUFFER,
-        sizeof(Constants::triangle_indices),
-        Constants::triangle_indices.data(),
-        GL_STATIC_DRAW);
+    // 4) Per-instance position, size, color, outline and shape
+    gl::add_instance_attributes();
 
     glBindVertexArray(global.vao_NONE);
 }
 
 auto cleanup() -> void {
+    if (global.capture.created) {
+        global.capture.destroy();
+        std::cout << "Captured " << global.capture.frames_written << " frames to " << global.capture.dir << " ("
+                  << global.capture.frames_dropped << " dropped, " << global.capture.write_failures << " failed)\n";
+    }
+    global.gpu_timer.destroy();
+    global.instance_stream.destroy();
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
@@ -1122,44 +1883,124 @@ auto cleanup() -> void {
 }
 
 auto main(int argc, char **argv) -> int {
+    float autosave_seconds = 0.0f;
+    bool profiler = true;
+    std::string capture_dir;
+    FrameCapture::Format capture_format = FrameCapture::Format::Png;
+    int capture_writers = default_capture_writers();
+    for (int i = 1; i < argc; ++i) {
+        if (std::string_view(argv[i]) == "--tick-rate" && i + 1 < argc) {
+            global.sim_thread.sim.tick_rate = std::atoi(argv[++i]);
+            if (global.sim_thread.sim.tick_rate <= 0) panic("Tick rate must be positive");
+            global.sim_thread.clock = FixedStepClock{global.sim_thread.sim.tick_rate};
+        } else if (std::string_view(argv[i]) == "--no-pipeline") {
+            global.sim_thread.pipelined = false;
+        } else if (std::string_view(argv[i]) == "--flow-field") {
+            global.sim_thread.sim.use_flow_field = true;
+        } else if (std::string_view(argv[i]) == "--no-profiler") {
+            profiler = false;
+        } else if (std::string_view(argv[i]) == "--record" && i + 1 < argc) {
+            global.sim_thread.record_path = argv[++i];
+        } else if (std::string_view(argv[i]) == "--autosave" && i + 1 < argc) {
+            autosave_seconds = std::strtof(argv[++i], nullptr);
+            if (autosave_seconds <= 0.0f) panic("Autosave interval must be positive");
+        } else if (std::string_view(argv[i]) == "--offscreen") {
+            global.offscreen = true;
+        } else if (std::string_view(argv[i]) == "--capture" && i + 1 < argc) {
+            capture_dir = argv[++i];
+        } else if (std::string_view(argv[i]) == "--capture-format" && i + 1 < argc) {
+            std::string_view format = argv[++i];
+            if (format == "png") {
+                capture_format = FrameCapture::Format::Png;
+            } else if (format == "raw") {
+                capture_format = FrameCapture::Format::Raw;
+            } else {
+                panic("Capture format must be png or raw");
+            }
+        } else if (std::string_view(argv[i]) == "--capture-frames" && i + 1 < argc) {
+            global.capture_frame_limit = std::atoll(argv[++i]);
+            if (global.capture_frame_limit <= 0) panic("Capture frame count must be positive");
+        } else if (std::string_view(argv[i]) == "--capture-writers" && i + 1 < argc) {
+            capture_writers = std::atoi(argv[++i]);
+            if (capture_writers <= 0) panic("Capture writer count must be positive");
+        }
+    }
+    if (global.capture_frame_limit > 0 && capture_dir.empty()) capture_dir = Constants::capture_dir;
+    // After the loop, the interval is in ticks of whatever tick rate was given
+    global.sim_thread.autosave_ticks = global.sim_thread.sim.seconds_to_ticks(autosave_seconds);
+
+    profiler_set_thread_name("main");
+    set_profiler_enabled(profiler);
     if (!setup()) panic("Setup failed!");
 
-    compile_shader_program_single_color();
-    compile_shader_program_tower_radius();
+    compile_shader_program_shapes();
+    create_frame_ubo();
+    // Room for about 26k instances per frame before the ring has to grow
+    global.instance_stream.create(1 << 20);
+    global.gpu_timer.create();
 
     create_vao_square();
-    create_vao_triangle();
-    creat_vao_triangle();
+
+    if (!capture_dir.empty()) {
+        if (!global.capture.create(capture_dir, capture_format, capture_writers)) panic("Capture setup failed!");
+        global.capture.active = true;
+    }
+    // Nobody watches an offscreen run, it waits for the writers instead of dropping frames
+    global.capture.never_drop = global.offscreen;
 
     global.running = true;
     global.run_start_time = std::chrono::steady_clock::now();
     // For initial delta time computation
     global.frame_start_time = global.run_start_time;
 
-    init_global();
+    init_simulation(global.sim_thread.sim);
+    global.sim_thread.start();
     while (global.running) {
+        TD_PROFILE_ZONE("frame");
         auto now = std::chrono::steady_clock::now();
         global.delta_time = now - global.frame_start_time;
         global.frame_start_time = now;
         global.runtime = now - global.run_start_time;
-
-        _main_handle_inputs();
-        for (auto &enemy : global.game.enemies) {
-            on_tick_enemy(enemy);
+        if (global.offscreen) {
+            global.delta_time = std::chrono::duration<float>(Constants::offscreen_frame_seconds);
+            global.runtime = global.delta_time * static_cast<float>(global.frame_counter);
         }
-        for (auto &tower : global.game.towers) {
-            on_tick_tower(tower);
+        global.frame_times_ms[global.frame_counter % global.frame_times_ms.size()] = global.delta_time.count() * 1000.0f;
+        AllocationCounts allocations = allocation_counts();
+        global.last_frame_allocations = allocations - global.frame_start_allocations;
+        global.frame_start_allocations = allocations;
+        // The first frames set everything up
+        if (global.frame_counter > 10) {
+            global.worst_frame_allocations = std::max(global.worst_frame_allocations, global.last_frame_allocations.allocations);
         }
+        global.frame_arena.reset();
+        global.instances = ArenaList<InstanceData>(global.frame_arena);
+        global.instance_layers = ArenaList<uint8_t>(global.frame_arena);
+
+        // Simulate this frame on the sim thread while drawing the snapshot of the previous one
+        _main_handle_inputs();
+        global.sim_thread.kick(global.delta_time);
 
         _main_imgui();
         _main_render();
 
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        SDL_GL_SwapWindow(global.window);
+        {
+            TD_PROFILE_ZONE("ImGui_ImplOpenGL3_RenderDrawData");
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            global.gpu_timer.end_pass(GpuPassTimer::ImGuiDraw);
+            global.gpu_timer.end_frame();
+        }
+        {
+            TD_PROFILE_ZONE("SDL_GL_SwapWindow");
+            SDL_GL_SwapWindow(global.window);
+        }
 
+        global.sim_thread.wait();
         global.frame_counter += 1;
+        if (global.capture_frame_limit > 0 && global.capture.frames_read >= global.capture_frame_limit) global.running = false;
     }
 
+    global.sim_thread.stop();
     cleanup();
 
     return EXIT_SUCCESS;
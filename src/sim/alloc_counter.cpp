@@ -0,0 +1,66 @@
+/* danielsinkin97@gmail.com */
+
+#include "alloc_counter.hpp"
+
+#include <cstdlib>
+#include <new>
+
+std::atomic<uint64_t> allocation_count{0};
+std::atomic<uint64_t> allocation_bytes{0};
+std::atomic<uint64_t> free_count{0};
+
+auto allocation_counts() -> AllocationCounts {
+    return AllocationCounts{allocation_count.load(std::memory_order_relaxed), allocation_bytes.load(std::memory_order_relaxed),
+                            free_count.load(std::memory_order_relaxed)};
+}
+
+auto counted_allocate(std::size_t size, std::size_t alignment) -> void * {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (alignment <= alignof(std::max_align_t)) return std::malloc(size);
+    // aligned_alloc wants the size to be a multiple of the alignment
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+auto counted_allocate_or_throw(std::size_t size, std::size_t alignment) -> void * {
+    void *p = counted_allocate(size, alignment);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+auto counted_free(void *p) -> void {
+    if (!p) return;
+    free_count.fetch_add(1, std::memory_order_relaxed);
+    std::free(p);
+}
+
+auto operator new(std::size_t size) -> void * { return counted_allocate_or_throw(size, 0); }
+auto operator new[](std::size_t size) -> void * { return counted_allocate_or_throw(size, 0); }
+auto operator new(std::size_t size, std::align_val_t alignment) -> void * {
+    return counted_allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+auto operator new[](std::size_t size, std::align_val_t alignment) -> void * {
+    return counted_allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+auto operator new(std::size_t size, const std::nothrow_t &) noexcept -> void * { return counted_allocate(size, 0); }
+auto operator new[](std::size_t size, const std::nothrow_t &) noexcept -> void * { return counted_allocate(size, 0); }
+auto operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept -> void * {
+    return counted_allocate(size, static_cast<std::size_t>(alignment));
+}
+auto operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept -> void * {
+    return counted_allocate(size, static_cast<std::size_t>(alignment));
+}
+
+auto operator delete(void *p) noexcept -> void { counted_free(p); }
+auto operator delete[](void *p) noexcept -> void { counted_free(p); }
+auto operator delete(void *p, std::size_t) noexcept -> void { counted_free(p); }
+auto operator delete[](void *p, std::size_t) noexcept -> void { counted_free(p); }
+auto operator delete(void *p, std::align_val_t) noexcept -> void { counted_free(p); }
+auto operator delete[](void *p, std::align_val_t) noexcept -> void { counted_free(p); }
+auto operator delete(void *p, std::size_t, std::align_val_t) noexcept -> void { counted_free(p); }
+auto operator delete[](void *p, std::size_t, std::align_val_t) noexcept -> void { counted_free(p); }
+auto operator delete(void *p, const std::nothrow_t &) noexcept -> void { counted_free(p); }
+auto operator delete[](void *p, const std::nothrow_t &) noexcept -> void { counted_free(p); }
+auto operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept -> void { counted_free(p); }
+auto operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept -> void { counted_free(p); }
@@ -0,0 +1,27 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+Counts every heap allocation made through operator new, on any thread, by replacing the global operator new
+and delete (alloc_counter.cpp, linked into everything that links td_sim). Plain malloc is not counted, the
+code here never calls it directly.
+
+Counting is two relaxed atomic adds per allocation. A frame (or tick) takes `allocation_counts()` before and
+after and subtracts, so whatever the other threads allocated in between counts towards it as well.
+*/
+struct AllocationCounts {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t frees = 0;
+};
+
+inline auto operator-(const AllocationCounts &a, const AllocationCounts &b) -> AllocationCounts {
+    return AllocationCounts{a.allocations - b.allocations, a.bytes - b.bytes, a.frees - b.frees};
+}
+
+// Totals since the start of the process.
+auto allocation_counts() -> AllocationCounts;
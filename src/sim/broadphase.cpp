@@ -0,0 +1,65 @@
+/* danielsinkin97@gmail.com */
+
+#include "broadphase.hpp"
+
+#include <algorithm>
+
+auto SweepAndPrune::find_overlapping_pairs(const EnemyStore &enemies, std::vector<OverlapPair> &out) -> void {
+    out.clear();
+
+    // Keep last tick's order minus the enemies that are gone, then append the ones spawned since.
+    order_slots.clear();
+    seen.assign(enemies.size(), 0);
+    for (EnemyId enemy_id : order) {
+        int slot = enemies.slot_of(enemy_id);
+        if (slot == -1) continue;
+        order_slots.push_back(slot);
+        seen[slot] = 1;
+    }
+    size_t kept = order_slots.size();
+    for (int slot = 0; slot < enemies.size(); ++slot) {
+        if (!seen[slot]) order_slots.push_back(slot);
+    }
+
+    auto left_edge_less = [&](int a, int b) {
+        float xa = enemies.x[a];
+        float xb = enemies.x[b];
+        return xa < xb || (xa == xb && a < b);
+    };
+    if (order_slots.size() - kept > 32) {
+        std::sort(order_slots.begin(), order_slots.end(), left_edge_less);
+    } else {
+        // Enemies barely move between ticks, insertion sort is close to linear on that input
+        for (size_t i = 1; i < order_slots.size(); ++i) {
+            int slot = order_slots[i];
+            size_t j = i;
+            while (j > 0 && left_edge_less(slot, order_slots[j - 1])) {
+                order_slots[j] = order_slots[j - 1];
+                --j;
+            }
+            order_slots[j] = slot;
+        }
+    }
+
+    order.resize(order_slots.size());
+    for (size_t i = 0; i < order_slots.size(); ++i) {
+        order[i] = enemies.id[order_slots[i]];
+    }
+
+    for (size_t i = 0; i < order_slots.size(); ++i) {
+        int a = order_slots[i];
+        Box box = enemies.box(a);
+        float right = box.position.x + box.width;
+        for (size_t j = i + 1; j < order_slots.size(); ++j) {
+            int b = order_slots[j];
+            if (enemies.x[b] >= right) break;
+            if (collision_box_box(box, enemies.box(b))) {
+                out.push_back(OverlapPair{std::min(a, b), std::max(a, b)});
+            }
+        }
+    }
+
+    std::sort(out.begin(), out.end(), [](const OverlapPair &l, const OverlapPair &r) {
+        return l.first < r.first || (l.first == r.first && l.second < r.second);
+    });
+}
@@ -0,0 +1,29 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include "enemy_store.hpp"
+
+#include <vector>
+
+// Store slots, always first < second.
+struct OverlapPair {
+    int first;
+    int second;
+};
+
+/*
+Sort-and-sweep broadphase along the x axis, which is the axis the path mostly runs along.
+
+Enemies are sorted by their left edge, every enemy is then only compared against the following ones whose
+left edge lies before its right edge. `order` holds the sorted ids between calls (slots don't survive a
+compaction), so the sort runs on already mostly sorted input; `order_slots` and `seen` are scratch space.
+`out` is cleared and filled with every overlapping pair sorted by (first, second), so the result does not
+depend on the order enemies were swept in.
+*/
+struct SweepAndPrune {
+    std::vector<EnemyId> order;
+    std::vector<int> order_slots;
+    std::vector<uint8_t> seen;
+
+    auto find_overlapping_pairs(const EnemyStore &enemies, std::vector<OverlapPair> &out) -> void;
+};
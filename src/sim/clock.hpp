@@ -0,0 +1,44 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+/*
+Fixed-timestep accumulator. The caller feeds it the wall time of each rendered frame and runs as many
+simulation ticks as it returns, the leftover fraction of a tick is used to interpolate the render.
+
+When a frame takes longer than `max_ticks_per_frame` ticks the surplus time is dropped instead of being
+carried over, so a stall slows the game down for a moment rather than spiralling into ever longer frames.
+*/
+struct FixedStepClock {
+    std::chrono::duration<double> step;
+    int max_ticks_per_frame = 5;
+    std::chrono::duration<double> accumulator{0.0};
+    // Ticks thrown away because of the catch-up bound, for the debug view
+    long long dropped_ticks = 0;
+
+    explicit FixedStepClock(int tick_rate, int max_ticks_per_frame_ = 5)
+        : step(1.0 / tick_rate), max_ticks_per_frame(max_ticks_per_frame_) {}
+
+    // Returns how many ticks to simulate for a frame that took `elapsed`.
+    auto advance(std::chrono::duration<double> elapsed) -> int {
+        accumulator += elapsed;
+        int ticks = 0;
+        while (accumulator >= step && ticks < max_ticks_per_frame) {
+            accumulator -= step;
+            ++ticks;
+        }
+        if (accumulator >= step) {
+            dropped_ticks += static_cast<long long>(accumulator / step);
+            accumulator = std::chrono::duration<double>(std::fmod(accumulator.count(), step.count()));
+        }
+        return ticks;
+    }
+
+    // Fraction of a tick since the last simulated tick, in [0, 1).
+    auto alpha() const -> float {
+        return static_cast<float>(std::clamp(accumulator / step, 0.0, 1.0));
+    }
+};
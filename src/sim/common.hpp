@@ -0,0 +1,183 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <glm/glm.hpp>
+using glm::vec2;
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+inline auto panic(const std::string &message) -> void {
+    std::cerr << "PANIC: " << message << std::endl;
+    std::exit(EXIT_FAILURE);
+}
+
+/*
+Constants the simulation depends on. Everything in here must stay free of SDL, OpenGL and ImGui so
+that td_sim can be linked into the headless targets.
+*/
+struct SimConstants {
+    // The playfield spans [-aspect_ratio, aspect_ratio] x [-1, 1] in NDC, the window uses the same ratio.
+    static constexpr float aspect_ratio = 1280.0f / 720.0f;
+
+    static constexpr float path_marker_width = 0.025f;
+    static constexpr float path_marker_height = 0.025f;
+
+    // The simulation advances in fixed ticks, every duration and speed below is converted with the tick rate.
+    static constexpr int default_tick_rate = 60;
+
+    // In seconds
+    static constexpr float projectile_life_time = 1.0f;
+
+    // In NDC units per second
+    static constexpr float enemy_speed = 0.06f;
+    static constexpr float projectile_speed = 0.6f;
+
+    static constexpr int max_tower_level = 5;
+    // Health of a freshly spawned enemy
+    static constexpr int enemy_hp = 100;
+
+    // Projectiles in flight before the pool has to grow, a tower fires at most twice per projectile lifetime
+    static constexpr int default_projectile_capacity = 256;
+
+    // Cell edge of the enemy grid in NDC units, about a third of the smallest tower range
+    static constexpr float enemy_grid_cell_size = 0.125f;
+    // Towers track the enemies within range plus this, in NDC units, and only rerun the range query once
+    // enemies may have moved further than it (about every 80 ticks at the default tick rate)
+    static constexpr float target_skin = 0.08f;
+    // Cell edge of the flow field in NDC units, half a tower so towers can wall off corridors
+    static constexpr float flow_field_cell_size = 0.05f;
+};
+
+struct Position {
+    float x;
+    float y;
+
+    Position() = default;
+    Position(float x_, float y_) : x(x_), y(y_) {}
+    Position(const vec2 &v) : x(v.x), y(v.y) {}
+    operator vec2() const { return {x, y}; }
+
+    Position operator+(const vec2 &v) const { return Position{x + v.x, y + v.y}; }
+    Position operator-(const vec2 &v) const { return Position{x - v.x, y - v.y}; }
+    Position &operator+=(const vec2 &v) {
+        x += v.x;
+        y += v.y;
+        return *this;
+    }
+    Position &operator-=(const vec2 &v) {
+        x -= v.x;
+        y -= v.y;
+        return *this;
+    }
+
+    vec2 to_glm() const { return vec2(x, y); }
+};
+
+inline std::ostream &operator<<(std::ostream &os, const Position &p) {
+    return os
+           << "Position("
+           << p.x << ", "
+           << p.y
+           << ")";
+}
+
+inline float distance(const Position &a, const Position &b) {
+    return glm::distance(a.to_glm(), b.to_glm());
+}
+
+inline auto lerp(const Position &a, const Position &b, float t) -> Position {
+    return Position{a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t};
+}
+
+inline auto window_normalized_to_ndc(const Position &norm_pos) -> Position {
+    auto pos = Position{
+        norm_pos.x * 2.0f - 1.0f,
+        1.0f - norm_pos.y * 2.0f};
+    pos.x *= SimConstants::aspect_ratio;
+    return pos;
+}
+
+inline auto ndc_to_window_normalized(const Position &ndc_pos) -> Position {
+    auto pos = Position{
+        (ndc_pos.x / SimConstants::aspect_ratio + 1.0f) * 0.5f,
+        (1.0f - ndc_pos.y) * 0.5f};
+    return pos;
+}
+
+struct Box {
+    Position position;
+    float width;
+    float height;
+    auto get_center() const -> Position {
+        return Position{position.x + width / 2.0f, position.y - height / 2.0f};
+    }
+    auto is_point_inside(Position pos) const -> bool {
+        return pos.x >= position.x &&
+               pos.x <= position.x + width &&
+               pos.y >= position.y - height &&
+               pos.y <= position.y;
+    }
+};
+inline float distance(const Box &a, const Box &b) {
+    return distance(a.get_center(), b.get_center());
+}
+
+enum class CollisionDirection {
+    None,
+    Left,
+    Right,
+    Top,
+    Bottom
+};
+
+inline auto collision_box_box_directional(const Box &b1, const Box &b2) -> CollisionDirection {
+    float left1 = b1.position.x;
+    float right1 = b1.position.x + b1.width;
+    float top1 = b1.position.y;
+    float bottom1 = b1.position.y - b1.height;
+
+    float left2 = b2.position.x;
+    float right2 = b2.position.x + b2.width;
+    float top2 = b2.position.y;
+    float bottom2 = b2.position.y - b2.height;
+
+    bool xcoll = (left1 < right2) &&
+                 (right1 > left2);
+    bool ycoll = (top1 > bottom2) &&
+                 (bottom1 < top2);
+    if (!(xcoll && ycoll)) {
+        return CollisionDirection::None;
+    }
+
+    float c1x = (left1 + right1) * 0.5f;
+    float c1y = (top1 + bottom1) * 0.5f;
+    float c2x = (left2 + right2) * 0.5f;
+    float c2y = (top2 + bottom2) * 0.5f;
+
+    float dx = c2x - c1x;
+    float dy = c2y - c1y;
+
+    float penX = (b1.width * 0.5f + b2.width * 0.5f) - std::abs(dx);
+    float penY = (b1.height * 0.5f + b2.height * 0.5f) - std::abs(dy);
+
+    if (penX < penY) {
+        return (dx > 0) ? CollisionDirection::Left : CollisionDirection::Right;
+    } else {
+        return (dy > 0) ? CollisionDirection::Bottom : CollisionDirection::Top;
+    }
+}
+
+inline auto collision_box_box(const Box b1, const Box b2) -> bool {
+    bool xcoll = b1.position.x < b2.position.x + b2.width &&
+                 b1.position.x + b1.width > b2.position.x;
+
+    bool ycoll = b1.position.y > b2.position.y - b2.height &&
+                 b1.position.y - b1.height < b2.position.y;
+
+    return xcoll && ycoll;
+}
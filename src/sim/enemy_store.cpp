@@ -0,0 +1,90 @@
+/* danielsinkin97@gmail.com */
+
+#include "enemy_store.hpp"
+
+#include <algorithm>
+#include <functional>
+
+auto EnemyStore::add(const Box &box, int hp_, int hp_max_) -> EnemyId {
+    uint32_t index;
+    if (!free_indices.empty()) {
+        index = free_indices.back();
+        free_indices.pop_back();
+    } else {
+        index = static_cast<uint32_t>(slot_of_index.size());
+        if (index > id_index_mask) panic("EnemyStore: out of enemy handles");
+        slot_of_index.push_back(-1);
+        generation.push_back(0);
+        // Neither can outgrow the handle table, so killing enemies never allocates
+        free_indices.reserve(slot_of_index.capacity());
+        dead_slots.reserve(slot_of_index.capacity());
+    }
+    EnemyId enemy_id = (generation[index] << id_index_bits) | index;
+    slot_of_index[index] = size();
+
+    x.push_back(box.position.x);
+    y.push_back(box.position.y);
+    w.push_back(box.width);
+    h.push_back(box.height);
+    prev_x.push_back(box.position.x);
+    prev_y.push_back(box.position.y);
+    hp.push_back(hp_);
+    hp_max.push_back(hp_max_);
+    progress.push_back(-1.0f);
+    id.push_back(enemy_id);
+    alive.push_back(1);
+    return enemy_id;
+}
+
+auto EnemyStore::remove_slot(int slot) -> void {
+    uint32_t index = id[slot] & id_index_mask;
+    slot_of_index[index] = -1;
+    // Wraps after 2^10 reuses of one index, long after any handle to the old enemy is gone
+    generation[index] = (generation[index] + 1) & (~0u >> id_index_bits);
+    free_indices.push_back(index);
+
+    int last = size() - 1;
+    if (slot != last) {
+        x[slot] = x[last];
+        y[slot] = y[last];
+        w[slot] = w[last];
+        h[slot] = h[last];
+        prev_x[slot] = prev_x[last];
+        prev_y[slot] = prev_y[last];
+        hp[slot] = hp[last];
+        hp_max[slot] = hp_max[last];
+        progress[slot] = progress[last];
+        id[slot] = id[last];
+        alive[slot] = alive[last];
+        slot_of_index[id[slot] & id_index_mask] = slot;
+    }
+    x.pop_back();
+    y.pop_back();
+    w.pop_back();
+    h.pop_back();
+    prev_x.pop_back();
+    prev_y.pop_back();
+    hp.pop_back();
+    hp_max.pop_back();
+    progress.pop_back();
+    id.pop_back();
+    alive.pop_back();
+}
+
+auto EnemyStore::compact() -> bool {
+    if (dead_slots.empty()) return false;
+    // Highest slot first: the element swapped in from the back is then never one that is still queued
+    std::sort(dead_slots.begin(), dead_slots.end(), std::greater<int>());
+    for (int slot : dead_slots) {
+        remove_slot(slot);
+    }
+    dead_slots.clear();
+    return true;
+}
+
+auto EnemyStore::clear() -> void {
+    while (!empty()) {
+        remove_slot(size() - 1);
+    }
+    dead_slots.clear();
+}
@@ -0,0 +1,87 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include "common.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/*
+Stable handle of an enemy. The low bits index `EnemyStore::slot_of_index`, the high bits are a generation
+counter so a handle of a dead enemy never resolves to whoever reuses its index.
+*/
+using EnemyId = uint32_t;
+
+/*
+Structure-of-arrays enemy storage. Slots [0, size()) are packed: between ticks every slot holds a live
+enemy, so passes over enemies are plain linear sweeps over the arrays without an `is_active` branch.
+
+Killing an enemy during a tick only clears `alive[slot]` and queues the slot, `compact` then swap-removes
+all queued slots at a point where nobody holds slot indices. Slots therefore change across compactions,
+anything that has to survive one (tower targets, the broadphase order) stores the `EnemyId` instead.
+
+Handle indices of removed enemies are recycled through a free list, so memory is bounded by the peak
+number of live enemies rather than by how many were ever spawned.
+*/
+struct EnemyStore {
+    static constexpr int id_index_bits = 22;
+    static constexpr uint32_t id_index_mask = (1u << id_index_bits) - 1;
+
+    // Box of the enemy: top left corner and size, same convention as `Box`
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> w;
+    std::vector<float> h;
+    // Top left corner at the start of the current tick, used to interpolate the render between ticks
+    std::vector<float> prev_x;
+    std::vector<float> prev_y;
+    std::vector<int> hp;
+    std::vector<int> hp_max;
+    // Arc length along `Simulation::path`, negative until the first tick put the enemy onto the path
+    std::vector<float> progress;
+    std::vector<EnemyId> id;
+    // 0 for slots killed during the current tick, they are removed by the next `compact`
+    std::vector<uint8_t> alive;
+
+    // Handle index -> slot (-1 if free) and the generation currently valid for that index
+    std::vector<int> slot_of_index;
+    std::vector<uint32_t> generation;
+    std::vector<uint32_t> free_indices;
+
+    std::vector<int> dead_slots;
+
+    auto size() const -> int { return static_cast<int>(id.size()); }
+    auto empty() const -> bool { return id.empty(); }
+
+    auto add(const Box &box, int hp_, int hp_max_) -> EnemyId;
+    // Slot of the enemy or -1 if it has been removed.
+    auto slot_of(EnemyId enemy_id) const -> int {
+        uint32_t index = enemy_id & id_index_mask;
+        if (index >= slot_of_index.size()) return -1;
+        if (generation[index] != (enemy_id >> id_index_bits)) return -1;
+        return slot_of_index[index];
+    }
+
+    auto box(int slot) const -> Box {
+        return Box{Position{x[slot], y[slot]}, w[slot], h[slot]};
+    }
+    auto center(int slot) const -> Position {
+        return box(slot).get_center();
+    }
+    auto interpolated_box(int slot, float alpha) const -> Box {
+        return Box{lerp(Position{prev_x[slot], prev_y[slot]}, Position{x[slot], y[slot]}, alpha), w[slot], h[slot]};
+    }
+
+    // Marks the slot dead, it keeps its data until the next `compact`. Killing twice is a no-op.
+    auto kill(int slot) -> void {
+        if (!alive[slot]) return;
+        alive[slot] = 0;
+        dead_slots.push_back(slot);
+    }
+    // Swap-removes every slot killed since the last call. Returns true if any slot moved.
+    auto compact() -> bool;
+    auto clear() -> void;
+
+  private:
+    auto remove_slot(int slot) -> void;
+};
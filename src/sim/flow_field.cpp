@@ -0,0 +1,184 @@
+/* danielsinkin97@gmail.com */
+
+#include "flow_field.hpp"
+
+FlowField::FlowField()
+    : FlowField(static_cast<int>(std::ceil(2.0f * SimConstants::aspect_ratio / SimConstants::flow_field_cell_size)),
+                static_cast<int>(std::ceil(2.0f / SimConstants::flow_field_cell_size)),
+                -SimConstants::aspect_ratio, -1.0f, SimConstants::flow_field_cell_size) {}
+
+FlowField::FlowField(int cols_, int rows_, float min_x_, float min_y_, float cell_size_)
+    : min_x(min_x_), min_y(min_y_), cell_size(cell_size_), cols(cols_), rows(rows_) {
+    if (cols <= 0 || rows <= 0) panic("Flow field needs at least one cell");
+    reset();
+}
+
+auto FlowField::cell_of(Position position) const -> int {
+    int cx = std::clamp(static_cast<int>(std::floor((position.x - min_x) / cell_size)), 0, cols - 1);
+    int cy = std::clamp(static_cast<int>(std::floor((position.y - min_y) / cell_size)), 0, rows - 1);
+    return cy * cols + cx;
+}
+
+auto FlowField::cell_center(int cell) const -> Position {
+    int cx = cell % cols;
+    int cy = cell / cols;
+    return Position{min_x + (cx + 0.5f) * cell_size, min_y + (cy + 0.5f) * cell_size};
+}
+
+auto FlowField::reset() -> void {
+    distance.assign(cell_count(), unreachable);
+    blockers.assign(cell_count(), 0);
+    goal.assign(cell_count(), 0);
+}
+
+auto FlowField::add_goal(const Box &box) -> void {
+    for_each_cell_overlapping(box, [&](int cell) { goal[cell] = 1; });
+}
+
+auto FlowField::neighbours(int cell, int out[4]) const -> int {
+    int cx = cell % cols;
+    int cy = cell / cols;
+    int count = 0;
+    // Fixed order, so ties in `next_cell` always resolve the same way
+    if (cx > 0) out[count++] = cell - 1;
+    if (cx + 1 < cols) out[count++] = cell + 1;
+    if (cy > 0) out[count++] = cell - cols;
+    if (cy + 1 < rows) out[count++] = cell + cols;
+    return count;
+}
+
+auto FlowField::best_neighbour_distance(int cell) const -> int {
+    int adjacent[4];
+    int count = neighbours(cell, adjacent);
+    int best = unreachable;
+    for (int i = 0; i < count; ++i) {
+        best = std::min(best, distance[adjacent[i]]);
+    }
+    return best == unreachable ? unreachable : best + 1;
+}
+
+auto FlowField::rebuild() -> void {
+    std::fill(distance.begin(), distance.end(), unreachable);
+    seeds.clear();
+    for (int cell = 0; cell < cell_count(); ++cell) {
+        if (is_goal(cell) && !is_blocked(cell)) {
+            distance[cell] = 0;
+            seeds.push_back(cell);
+        }
+    }
+    relax_from_seeds();
+}
+
+auto FlowField::relax_from_seeds() -> void {
+    // Two sorted sources merged by distance: the seeds and the FIFO of relaxed cells, which is sorted because
+    // every cell enters it one step further than the cell it was reached from.
+    queue.clear();
+    size_t queue_head = 0;
+    size_t seed_head = 0;
+    while (queue_head < queue.size() || seed_head < seeds.size()) {
+        bool take_seed = seed_head < seeds.size() &&
+                         (queue_head == queue.size() || distance[seeds[seed_head]] <= distance[queue[queue_head]]);
+        int cell = take_seed ? seeds[seed_head++] : queue[queue_head++];
+
+        int next_distance = distance[cell] + 1;
+        int adjacent[4];
+        int count = neighbours(cell, adjacent);
+        for (int i = 0; i < count; ++i) {
+            int next = adjacent[i];
+            if (is_blocked(next) || distance[next] <= next_distance) continue;
+            distance[next] = next_distance;
+            queue.push_back(next);
+        }
+    }
+}
+
+auto FlowField::repair_after_block(int cell) -> void {
+    int old_distance = distance[cell];
+    distance[cell] = unreachable;
+    if (old_distance == unreachable) return;
+
+    // Invalidate outwards. The list is in order of old distance, so by the time the cells at distance d are
+    // looked at, everything at d - 1 that lost its route is already unreachable and can't count as a parent.
+    invalidated.assign(1, cell);
+    invalidated_distance.assign(1, old_distance);
+    for (size_t head = 0; head < invalidated.size(); ++head) {
+        int child_distance = invalidated_distance[head] + 1;
+        int adjacent[4];
+        int count = neighbours(invalidated[head], adjacent);
+        for (int i = 0; i < count; ++i) {
+            int child = adjacent[i];
+            if (distance[child] != child_distance) continue;
+            int parents[4];
+            int parent_count = neighbours(child, parents);
+            bool has_other_parent = false;
+            for (int k = 0; k < parent_count; ++k) {
+                has_other_parent |= distance[parents[k]] == child_distance - 1;
+            }
+            if (has_other_parent) continue;
+            distance[child] = unreachable;
+            invalidated.push_back(child);
+            invalidated_distance.push_back(child_distance);
+        }
+    }
+
+    // Refill from the cells that kept their distance. The blocked cell itself stays unreachable.
+    seeds.clear();
+    for (size_t i = 1; i < invalidated.size(); ++i) {
+        int lost = invalidated[i];
+        distance[lost] = best_neighbour_distance(lost);
+        if (distance[lost] != unreachable) seeds.push_back(lost);
+    }
+    std::sort(seeds.begin(), seeds.end(), [&](int a, int b) { return distance[a] < distance[b]; });
+    relax_from_seeds();
+    last_repair_cells += static_cast<int>(invalidated.size());
+}
+
+auto FlowField::repair_after_unblock(int cell) -> void {
+    distance[cell] = is_goal(cell) ? 0 : best_neighbour_distance(cell);
+    last_repair_cells += 1;
+    if (distance[cell] == unreachable) return;
+    seeds.assign(1, cell);
+    relax_from_seeds();
+    last_repair_cells += static_cast<int>(queue.size());
+}
+
+auto FlowField::add_blocker(int cell) -> void {
+    blockers[cell] += 1;
+    if (blockers[cell] == 1) repair_after_block(cell);
+}
+
+auto FlowField::remove_blocker(int cell) -> void {
+    if (blockers[cell] <= 0) panic("Removing a blocker from a free flow field cell");
+    blockers[cell] -= 1;
+    if (blockers[cell] == 0) repair_after_unblock(cell);
+}
+
+auto FlowField::add_blocker(const Box &box) -> void {
+    last_repair_cells = 0;
+    for_each_cell_overlapping(box, [&](int cell) { add_blocker(cell); });
+}
+
+auto FlowField::remove_blocker(const Box &box) -> void {
+    last_repair_cells = 0;
+    for_each_cell_overlapping(box, [&](int cell) { remove_blocker(cell); });
+}
+
+auto FlowField::next_cell(int cell) const -> int {
+    int adjacent[4];
+    int count = neighbours(cell, adjacent);
+    int best = -1;
+    int best_distance = distance[cell];
+    for (int i = 0; i < count; ++i) {
+        if (distance[adjacent[i]] < best_distance) {
+            best = adjacent[i];
+            best_distance = distance[adjacent[i]];
+        }
+    }
+    return best;
+}
+
+auto FlowField::progress_at(int cell) const -> float {
+    // Cells that can't reach a goal count as the very start
+    if (distance[cell] == unreachable) return 0.0f;
+    return static_cast<float>(cell_count() - distance[cell]) * cell_size;
+}
@@ -0,0 +1,100 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/*
+Distance to the exit for every cell of a uniform grid over the playfield, in 4-connected steps around the
+cells covered by towers. An enemy looks up its cell and walks to the neighbour with the smallest distance,
+that is a handful of loads no matter how the map looks.
+
+Placing or removing a tower only repairs the part of the field it changes:
+
+- Blocking a cell first invalidates every cell whose shortest routes all went through it (walking outwards
+  from the cell while a neighbour has no other parent one step closer), then refills the invalidated cells
+  from their valid neighbours in distance order.
+- Unblocking a cell gives it the best distance of its neighbours and relaxes outwards from there.
+
+Both only touch the cells whose distance actually changes plus their neighbours. `rebuild` runs the full
+BFS from the goal cells and is what the repairs are checked against.
+*/
+struct FlowField {
+    static constexpr int unreachable = std::numeric_limits<int>::max();
+
+    float min_x = -SimConstants::aspect_ratio;
+    float min_y = -1.0f;
+    float cell_size = SimConstants::flow_field_cell_size;
+    int cols = 0;
+    int rows = 0;
+
+    // Steps to the closest goal, `unreachable` for blocked cells and cells walled off from every goal
+    std::vector<int> distance;
+    // Number of towers covering each cell, the cell is blocked while it is above zero
+    std::vector<int> blockers;
+    std::vector<uint8_t> goal;
+
+    // Cells whose distance changed in the last `add_blocker` / `remove_blocker` of a box, for the benchmark
+    int last_repair_cells = 0;
+
+    // Covers the playfield with `SimConstants::flow_field_cell_size` cells.
+    FlowField();
+    FlowField(int cols, int rows, float min_x, float min_y, float cell_size);
+
+    auto cell_count() const -> int { return cols * rows; }
+    auto cell_of(Position position) const -> int;
+    auto cell_center(int cell) const -> Position;
+    auto is_blocked(int cell) const -> bool { return blockers[cell] > 0; }
+    auto is_goal(int cell) const -> bool { return goal[cell] != 0; }
+
+    // Drops every goal and blocker, distances stay unreachable until the next `rebuild`.
+    auto reset() -> void;
+    // Marks every cell the box overlaps as a goal, takes effect at the next `rebuild`.
+    auto add_goal(const Box &box) -> void;
+    // Full BFS from the goal cells.
+    auto rebuild() -> void;
+
+    // Count one more or one less tower on every cell the box overlaps and repair the cells that change state.
+    auto add_blocker(const Box &box) -> void;
+    auto remove_blocker(const Box &box) -> void;
+    auto add_blocker(int cell) -> void;
+    auto remove_blocker(int cell) -> void;
+
+    // Neighbour to walk to from `cell`, -1 if none is closer to a goal (at a goal or walled in).
+    auto next_cell(int cell) const -> int;
+    // Grows towards the goal, so sorting by it orders enemies by how far along they are.
+    auto progress_at(int cell) const -> float;
+
+    // Calls f(cell) for every cell whose interior the box overlaps.
+    template <typename F>
+    auto for_each_cell_overlapping(const Box &box, F &&f) const -> void {
+        int x0 = std::max(static_cast<int>(std::floor((box.position.x - min_x) / cell_size)), 0);
+        int x1 = std::min(static_cast<int>(std::ceil((box.position.x + box.width - min_x) / cell_size)), cols);
+        int y0 = std::max(static_cast<int>(std::floor((box.position.y - box.height - min_y) / cell_size)), 0);
+        int y1 = std::min(static_cast<int>(std::ceil((box.position.y - min_y) / cell_size)), rows);
+        for (int cy = y0; cy < y1; ++cy) {
+            for (int cx = x0; cx < x1; ++cx) {
+                f(cy * cols + cx);
+            }
+        }
+    }
+
+  private:
+    // Writes the up to four neighbours of `cell` to `out`, returns how many there are.
+    auto neighbours(int cell, int out[4]) const -> int;
+    auto best_neighbour_distance(int cell) const -> int;
+    auto repair_after_block(int cell) -> void;
+    auto repair_after_unblock(int cell) -> void;
+    // Lowers distances outwards from `seeds` (sorted by distance), visiting cells in distance order.
+    auto relax_from_seeds() -> void;
+
+    // Scratch, kept to avoid reallocating on every repair
+    std::vector<int> queue;
+    std::vector<int> seeds;
+    std::vector<int> invalidated;
+    std::vector<int> invalidated_distance;
+};
@@ -0,0 +1,32 @@
+/* danielsinkin97@gmail.com */
+
+#include "frame_arena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+FrameArena::FrameArena(size_t capacity_) : block(std::make_unique_for_overwrite<std::byte[]>(capacity_)), capacity(capacity_) {}
+
+auto FrameArena::reset() -> void {
+    size_t frame_bytes = bytes_used();
+    last_frame_bytes = frame_bytes;
+    high_water = std::max(high_water, frame_bytes);
+    if (!overflow.empty()) {
+        // Room for the whole frame plus some slack, so a slowly growing workload does not regrow every frame
+        capacity = std::max(2 * capacity, frame_bytes + frame_bytes / 2);
+        block = std::make_unique_for_overwrite<std::byte[]>(capacity);
+        overflow.clear();
+        overflow_bytes = 0;
+        grows += 1;
+    }
+    used = 0;
+}
+
+auto FrameArena::allocate_overflow(size_t size, size_t alignment) -> void * {
+    // operator new[] only guarantees the default alignment, pad for anything stricter
+    size_t padded = size + alignment;
+    overflow.push_back(std::make_unique_for_overwrite<std::byte[]>(padded));
+    overflow_bytes += padded;
+    auto address = reinterpret_cast<uintptr_t>(overflow.back().get());
+    return reinterpret_cast<std::byte *>((address + alignment - 1) & ~(alignment - 1));
+}
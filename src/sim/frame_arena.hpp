@@ -0,0 +1,95 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/*
+Linear allocator for lists that only live for one frame. `allocate` bumps a pointer, `reset` at the start of
+the next frame drops everything at once. Nothing is destructed, so it only hands out trivially destructible
+types.
+
+A frame that runs past the end of the block continues in extra blocks from the heap. The next `reset` frees
+them and grows the main block to the whole of that frame, so after the first few frames a steady workload
+never touches the heap again.
+*/
+struct FrameArena {
+    explicit FrameArena(size_t capacity = 1 << 16);
+
+    FrameArena(const FrameArena &) = delete;
+    auto operator=(const FrameArena &) -> FrameArena & = delete;
+
+    auto allocate_bytes(size_t size, size_t alignment) -> void * {
+        size_t begin = (used + alignment - 1) & ~(alignment - 1);
+        if (begin + size > capacity) return allocate_overflow(size, alignment);
+        used = begin + size;
+        return block.get() + begin;
+    }
+    template <typename T>
+    auto allocate(size_t count) -> T * {
+        static_assert(std::is_trivially_destructible_v<T>, "FrameArena never runs destructors");
+        return static_cast<T *>(allocate_bytes(count * sizeof(T), alignof(T)));
+    }
+
+    auto reset() -> void;
+
+    // Bytes handed out since the last reset, including the overflow blocks
+    auto bytes_used() const -> size_t { return used + overflow_bytes; }
+    auto bytes_capacity() const -> size_t { return capacity; }
+    // Bytes the frame before the last reset used, and the most any frame so far used
+    size_t last_frame_bytes = 0;
+    size_t high_water = 0;
+    // Times the main block had to grow
+    int grows = 0;
+
+  private:
+    auto allocate_overflow(size_t size, size_t alignment) -> void *;
+
+    std::unique_ptr<std::byte[]> block;
+    size_t capacity = 0;
+    size_t used = 0;
+    std::vector<std::unique_ptr<std::byte[]>> overflow;
+    size_t overflow_bytes = 0;
+};
+
+// Growable list in a `FrameArena`, for when the final count is not known up front. Growing copies into
+// a fresh allocation and abandons the old one until the arena resets.
+template <typename T>
+struct ArenaList {
+    static_assert(std::is_trivially_copyable_v<T>, "ArenaList moves its items with memcpy");
+
+    explicit ArenaList(FrameArena &arena_) : arena(&arena_) {}
+
+    auto push_back(const T &item) -> void {
+        if (count == capacity) grow();
+        items[count++] = item;
+    }
+    auto clear() -> void { count = 0; }
+
+    auto size() const -> size_t { return count; }
+    auto empty() const -> bool { return count == 0; }
+    auto data() const -> const T * { return items; }
+    auto begin() const -> const T * { return items; }
+    auto end() const -> const T * { return items + count; }
+    auto begin() -> T * { return items; }
+    auto end() -> T * { return items + count; }
+    auto operator[](size_t i) -> T & { return items[i]; }
+    auto operator[](size_t i) const -> const T & { return items[i]; }
+
+  private:
+    auto grow() -> void {
+        size_t new_capacity = capacity == 0 ? 64 : 2 * capacity;
+        T *grown = arena->allocate<T>(new_capacity);
+        if (count > 0) std::memcpy(grown, items, count * sizeof(T));
+        items = grown;
+        capacity = new_capacity;
+    }
+
+    FrameArena *arena;
+    T *items = nullptr;
+    size_t count = 0;
+    size_t capacity = 0;
+};
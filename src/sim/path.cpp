@@ -0,0 +1,52 @@
+/* danielsinkin97@gmail.com */
+
+#include "path.hpp"
+
+#include <algorithm>
+#include <limits>
+
+auto PathPolyline::build(const std::vector<Position> &marker_positions) -> void {
+    if (marker_positions.size() < 2) panic("A path needs at least two markers");
+    points = marker_positions;
+    cumulative.assign(1, 0.0f);
+    directions.clear();
+    for (size_t i = 0; i + 1 < points.size(); ++i) {
+        vec2 delta = (points[i + 1] - points[i]).to_glm();
+        float segment_length = glm::length(delta);
+        if (segment_length <= 0.0f) panic("Path markers must not repeat");
+        directions.push_back(delta / segment_length);
+        cumulative.push_back(cumulative.back() + segment_length);
+    }
+    length = cumulative.back();
+}
+
+auto PathPolyline::segment_at(float progress) const -> int {
+    // First cumulative length past `progress`, the segment starts one before it
+    auto it = std::upper_bound(cumulative.begin(), cumulative.end(), progress);
+    int segment = static_cast<int>(it - cumulative.begin()) - 1;
+    return std::clamp(segment, 0, segment_count() - 1);
+}
+
+auto PathPolyline::position_at(float progress) const -> Position {
+    int segment = segment_at(progress);
+    float along = progress - cumulative[segment];
+    return points[segment] + directions[segment] * along;
+}
+
+auto PathPolyline::project(Position position) const -> float {
+    float best_progress = 0.0f;
+    float best_dist2 = std::numeric_limits<float>::infinity();
+    for (int segment = 0; segment < segment_count(); ++segment) {
+        vec2 offset = (position - points[segment]).to_glm();
+        float segment_length = cumulative[segment + 1] - cumulative[segment];
+        float along = std::clamp(glm::dot(offset, directions[segment]), 0.0f, segment_length);
+        vec2 closest = directions[segment] * along;
+        vec2 to_closest = offset - closest;
+        float dist2 = glm::dot(to_closest, to_closest);
+        if (dist2 < best_dist2) {
+            best_dist2 = dist2;
+            best_progress = cumulative[segment] + along;
+        }
+    }
+    return best_progress;
+}
@@ -0,0 +1,42 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include "common.hpp"
+
+#include <array>
+#include <vector>
+
+/*
+The enemy path as a polyline through the path marker positions, parameterized by arc length. An enemy only
+stores how far along the path it is, its position is one segment lookup plus a multiply-add, and moving it
+is adding speed * dt, so movement needs no sqrt or normalize.
+
+Positions are top left corners like `Box::position`, the same point enemies used to steer towards.
+*/
+struct PathPolyline {
+    // Segment i runs from points[i] to points[i + 1], starting at arc length cumulative[i]
+    std::vector<Position> points;
+    std::vector<float> cumulative;
+    // Unit direction of each segment
+    std::vector<vec2> directions;
+    float length = 0.0f;
+
+    PathPolyline() = default;
+    template <size_t N>
+    explicit PathPolyline(const std::array<Box, N> &markers) {
+        std::vector<Position> marker_positions;
+        for (const Box &marker : markers) {
+            marker_positions.push_back(marker.position);
+        }
+        build(marker_positions);
+    }
+
+    auto build(const std::vector<Position> &marker_positions) -> void;
+
+    auto segment_count() const -> int { return static_cast<int>(directions.size()); }
+    // Segment containing `progress` (clamped to the path), binary search over the cumulative lengths.
+    auto segment_at(float progress) const -> int;
+    auto position_at(float progress) const -> Position;
+    // Arc length of the point on the path closest to `position`, ties go to the earlier segment.
+    auto project(Position position) const -> float;
+};
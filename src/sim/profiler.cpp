@@ -0,0 +1,133 @@
+/* danielsinkin97@gmail.com */
+
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+std::atomic<bool> profiler_on{false};
+
+// Every ring ever registered. Threads only lock it to register, rings are never freed so a reader can still
+// copy out the zones of threads that ended.
+struct ProfilerRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ProfileRing>> rings;
+    std::vector<std::string> names;
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+auto profiler_registry() -> ProfilerRegistry & {
+    static ProfilerRegistry registry;
+    return registry;
+}
+
+thread_local ProfileRing *this_thread_ring = nullptr;
+thread_local int this_thread_profile_id = -1;
+
+auto set_profiler_enabled(bool enabled) -> void {
+    profiler_on.store(enabled, std::memory_order_relaxed);
+}
+
+auto profiler_now_ns() -> int64_t {
+    auto since_epoch = std::chrono::steady_clock::now() - profiler_registry().epoch;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+}
+
+auto register_ring(const std::string &name, int &id) -> ProfileRing & {
+    ProfilerRegistry &registry = profiler_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    id = static_cast<int>(registry.rings.size());
+    registry.rings.push_back(std::make_unique<ProfileRing>());
+    registry.names.push_back(name.empty() ? "thread " + std::to_string(id) : name);
+    return *registry.rings.back();
+}
+
+auto profiler_thread_ring() -> ProfileRing & {
+    if (!this_thread_ring) this_thread_ring = &register_ring("", this_thread_profile_id);
+    return *this_thread_ring;
+}
+
+auto profiler_add_ring(const char *name) -> ProfileRing & {
+    int id;
+    return register_ring(name, id);
+}
+
+auto profiler_set_thread_name(const char *name) -> void {
+    profiler_thread_ring();
+    ProfilerRegistry &registry = profiler_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.names[this_thread_profile_id] = name;
+}
+
+auto profiler_collect(int64_t since_ns, std::vector<ProfileThreadEvents> &out) -> void {
+    // Entries and their buffers are reused from the last call, so collecting every frame stops allocating
+    // once they are big enough
+    size_t used = 0;
+    ProfilerRegistry &registry = profiler_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (size_t id = 0; id < registry.rings.size(); ++id) {
+        const ProfileRing &ring = *registry.rings[id];
+        uint64_t written = ring.written.load(std::memory_order_acquire);
+        uint64_t first = written > ProfileRing::capacity ? written - ProfileRing::capacity : 0;
+        if (used == out.size()) out.emplace_back();
+        ProfileThreadEvents &thread = out[used];
+        thread.thread_id = static_cast<int>(id);
+        thread.thread_name = registry.names[id];
+        thread.events.clear();
+        // Newest first, zones are written in order of their end so the scan can stop at the first older one.
+        // `events[i]` is copied from slot `written - 1 - i`.
+        for (uint64_t index = written; index-- > first;) {
+            const ProfileRing::Slot &slot = ring.slots[index & (ProfileRing::capacity - 1)];
+            ProfileZoneEvent event{slot.name.load(std::memory_order_relaxed), slot.start_ns.load(std::memory_order_relaxed),
+                                   slot.end_ns.load(std::memory_order_relaxed), slot.depth.load(std::memory_order_relaxed)};
+            if (event.end_ns < since_ns) break;
+            thread.events.push_back(event);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t begun = ring.begun.load(std::memory_order_relaxed);
+        // Slot `index` is reused by write `index + capacity`, which bumps `begun` past it, so only the copies
+        // of slots at or after `begun - capacity` are intact: the newest `written + capacity - begun` of them
+        uint64_t intact = written + ProfileRing::capacity > begun ? written + ProfileRing::capacity - begun : 0;
+        if (thread.events.size() > intact) thread.events.resize(intact);
+        std::reverse(thread.events.begin(), thread.events.end());
+        if (!thread.events.empty()) used += 1;
+    }
+    out.resize(used);
+}
+
+auto write_chrome_trace(const std::string &path) -> bool {
+    std::vector<ProfileThreadEvents> threads;
+    profiler_collect(0, threads);
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to open " << path << " for writing\n";
+        return false;
+    }
+    // Complete events ("ph": "X") with microsecond timestamps, plus one metadata event naming each thread.
+    // Fixed notation keeps nanosecond resolution, the default 6 significant digits would round ts to 10 us
+    // after 1 s and to 100 us after 10 s.
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    auto separator = [&]() -> const char * {
+        const char *s = first ? "" : ",\n";
+        first = false;
+        return s;
+    };
+    for (const ProfileThreadEvents &thread : threads) {
+        out << separator() << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << thread.thread_id
+            << R"(,"args":{"name":")" << thread.thread_name << "\"}}";
+        for (const ProfileZoneEvent &event : thread.events) {
+            out << separator() << R"({"name":")" << event.name << R"(","ph":"X","pid":1,"tid":)" << thread.thread_id
+                << ",\"ts\":" << static_cast<double>(event.start_ns) / 1000.0
+                << ",\"dur\":" << static_cast<double>(event.end_ns - event.start_ns) / 1000.0 << "}";
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
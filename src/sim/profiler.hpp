@@ -0,0 +1,115 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+Scoped zone profiler. `TD_PROFILE_ZONE("name")` times the rest of the enclosing scope and, when the scope
+ends, writes the zone into a ring owned by the current thread. Every ring has exactly one writer, so
+recording takes no lock; readers copy the rings out while they are being written and drop whatever the
+writer may have overwritten during the copy.
+
+While the profiler is off a zone costs one relaxed load and a branch. Building with TD_DISABLE_PROFILER
+removes the zones altogether. Zone names are stored as pointers, so they have to be string literals.
+*/
+struct ProfileZoneEvent {
+    const char *name;
+    int64_t start_ns;
+    int64_t end_ns;
+    // Number of zones of the same thread this one is nested in
+    int depth;
+};
+
+// The zones of one thread, as copied out by `profiler_collect`.
+struct ProfileThreadEvents {
+    int thread_id;
+    std::string thread_name;
+    // Ordered by end time
+    std::vector<ProfileZoneEvent> events;
+};
+
+struct ProfileRing {
+    static constexpr uint64_t capacity = 1 << 14;
+
+    // A seqlock per ring: the writer bumps `begun` before it touches a slot and `written` once it is done,
+    // readers copy the slots below `written` and afterwards drop every one a write begun since could have hit
+    struct Slot {
+        std::atomic<const char *> name{nullptr};
+        std::atomic<int64_t> start_ns{0};
+        std::atomic<int64_t> end_ns{0};
+        std::atomic<int> depth{0};
+    };
+    std::array<Slot, capacity> slots;
+    // Zones ever written to this ring, the latest `capacity` of them are still in it
+    std::atomic<uint64_t> begun{0};
+    std::atomic<uint64_t> written{0};
+    // Only touched by the owning thread
+    int depth = 0;
+
+    auto push(const char *name, int64_t start_ns, int64_t end_ns, int depth_) -> void {
+        uint64_t index = written.load(std::memory_order_relaxed);
+        begun.store(index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        Slot &slot = slots[index & (capacity - 1)];
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.start_ns.store(start_ns, std::memory_order_relaxed);
+        slot.end_ns.store(end_ns, std::memory_order_relaxed);
+        slot.depth.store(depth_, std::memory_order_relaxed);
+        written.store(index + 1, std::memory_order_release);
+    }
+};
+
+extern std::atomic<bool> profiler_on;
+
+inline auto profiler_enabled() -> bool { return profiler_on.load(std::memory_order_relaxed); }
+auto set_profiler_enabled(bool enabled) -> void;
+// Nanoseconds since the profiler started, the time base of every zone.
+auto profiler_now_ns() -> int64_t;
+// Ring of the calling thread, registered on first use.
+auto profiler_thread_ring() -> ProfileRing &;
+// Name the calling thread shows up under, threads without one are called "thread N".
+auto profiler_set_thread_name(const char *name) -> void;
+// Extra lane for zones that don't come from a zone guard, like GPU timings read back later. Whoever writes
+// to it has to be its only writer.
+auto profiler_add_ring(const char *name) -> ProfileRing &;
+
+// Copies out every recorded zone that ended at or after `since_ns`, one entry per thread that has any. Reuses
+// what `out` held, so passing the same vector every frame does not allocate in the steady state.
+auto profiler_collect(int64_t since_ns, std::vector<ProfileThreadEvents> &out) -> void;
+// Writes every zone still in the rings as Chrome trace_event JSON (chrome://tracing, Perfetto).
+auto write_chrome_trace(const std::string &path) -> bool;
+
+struct ProfileZone {
+    const char *name;
+    ProfileRing *ring = nullptr;
+    int64_t start_ns = 0;
+    int depth = 0;
+
+    explicit ProfileZone(const char *name_) : name(name_) {
+        if (!profiler_enabled()) return;
+        ring = &profiler_thread_ring();
+        depth = ring->depth++;
+        start_ns = profiler_now_ns();
+    }
+    ~ProfileZone() {
+        if (!ring) return;
+        int64_t end_ns = profiler_now_ns();
+        ring->depth -= 1;
+        ring->push(name, start_ns, end_ns, depth);
+    }
+
+    ProfileZone(const ProfileZone &) = delete;
+    auto operator=(const ProfileZone &) -> ProfileZone & = delete;
+};
+
+#define TD_PROFILE_CONCAT_INNER(a, b) a##b
+#define TD_PROFILE_CONCAT(a, b) TD_PROFILE_CONCAT_INNER(a, b)
+#ifdef TD_DISABLE_PROFILER
+#define TD_PROFILE_ZONE(name) ((void)0)
+#else
+#define TD_PROFILE_ZONE(name) ProfileZone TD_PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#endif
@@ -0,0 +1,95 @@
+/* danielsinkin97@gmail.com */
+
+#include "projectile_store.hpp"
+
+#include <algorithm>
+#include <functional>
+
+auto ProjectileStore::capacity() const -> int {
+    size_t capacity = std::min({x.capacity(), y.capacity(), prev_x.capacity(), prev_y.capacity(), dir_x.capacity(),
+                                dir_y.capacity(), damage.capacity(), tower_idx.capacity(), expire_tick.capacity(),
+                                alive.capacity(), dead_slots.capacity()});
+    return static_cast<int>(capacity);
+}
+
+auto ProjectileStore::reserve(int capacity) -> void {
+    x.reserve(capacity);
+    y.reserve(capacity);
+    prev_x.reserve(capacity);
+    prev_y.reserve(capacity);
+    dir_x.reserve(capacity);
+    dir_y.reserve(capacity);
+    damage.reserve(capacity);
+    tower_idx.reserve(capacity);
+    expire_tick.reserve(capacity);
+    alive.reserve(capacity);
+    dead_slots.reserve(capacity);
+}
+
+auto ProjectileStore::add(Position position, vec2 dir, int damage_, int tower_idx_, long long expire_tick_) -> int {
+    if (size() >= capacity()) {
+        reserve(std::max(2 * size(), 16));
+        grows += 1;
+    }
+    int slot = size();
+    x.push_back(position.x);
+    y.push_back(position.y);
+    prev_x.push_back(position.x);
+    prev_y.push_back(position.y);
+    dir_x.push_back(dir.x);
+    dir_y.push_back(dir.y);
+    damage.push_back(damage_);
+    tower_idx.push_back(tower_idx_);
+    expire_tick.push_back(expire_tick_);
+    alive.push_back(1);
+    return slot;
+}
+
+auto ProjectileStore::remove_slot(int slot) -> void {
+    int last = size() - 1;
+    if (slot != last) {
+        x[slot] = x[last];
+        y[slot] = y[last];
+        prev_x[slot] = prev_x[last];
+        prev_y[slot] = prev_y[last];
+        dir_x[slot] = dir_x[last];
+        dir_y[slot] = dir_y[last];
+        damage[slot] = damage[last];
+        tower_idx[slot] = tower_idx[last];
+        expire_tick[slot] = expire_tick[last];
+        alive[slot] = alive[last];
+    }
+    x.pop_back();
+    y.pop_back();
+    prev_x.pop_back();
+    prev_y.pop_back();
+    dir_x.pop_back();
+    dir_y.pop_back();
+    damage.pop_back();
+    tower_idx.pop_back();
+    expire_tick.pop_back();
+    alive.pop_back();
+}
+
+auto ProjectileStore::compact() -> void {
+    // Highest slot first: the element swapped in from the back is then never one that is still queued
+    std::sort(dead_slots.begin(), dead_slots.end(), std::greater<int>());
+    for (int slot : dead_slots) {
+        remove_slot(slot);
+    }
+    dead_slots.clear();
+}
+
+auto ProjectileStore::clear() -> void {
+    x.clear();
+    y.clear();
+    prev_x.clear();
+    prev_y.clear();
+    dir_x.clear();
+    dir_y.clear();
+    damage.clear();
+    tower_idx.clear();
+    expire_tick.clear();
+    alive.clear();
+    dead_slots.clear();
+}
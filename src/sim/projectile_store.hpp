@@ -0,0 +1,70 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include "common.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/*
+Structure-of-arrays pool of every projectile in flight, shared by all towers. Slots [0, size()) are the
+active projectiles, so the projectile pass and the render walk one dense range. Slots [size(), capacity())
+are the free list: `add` takes the first of them in O(1) and `compact` returns finished slots to it by
+swapping the last active projectile in, O(k log k) for k finished projectiles as it sorts them first.
+
+Like `EnemyStore`, finishing a projectile during a tick only clears `alive[slot]`; slots move at the
+`compact` in the merge phase, when nothing holds projectile slots. The pool starts at the capacity it was
+reserved with and doubles when a shot would not fit, so no shot is ever dropped.
+*/
+struct ProjectileStore {
+    static constexpr float size_ndc = 0.02f;
+
+    // Top left corner, same convention as `Box`
+    std::vector<float> x;
+    std::vector<float> y;
+    // Position at the start of the current tick, used to interpolate the render between ticks
+    std::vector<float> prev_x;
+    std::vector<float> prev_y;
+    // Unit direction of flight
+    std::vector<float> dir_x;
+    std::vector<float> dir_y;
+    // Damage of the firing tower when it fired, so hits don't depend on the tower afterwards
+    std::vector<int> damage;
+    std::vector<int> tower_idx;
+    // First tick on which the projectile is gone
+    std::vector<long long> expire_tick;
+    // 0 once the projectile hit or expired, removed by the next `compact`
+    std::vector<uint8_t> alive;
+
+    std::vector<int> dead_slots;
+    // Times the pool had to grow past its capacity
+    int grows = 0;
+
+    auto size() const -> int { return static_cast<int>(x.size()); }
+    auto empty() const -> bool { return x.empty(); }
+    // Projectiles that fit without allocating, the smallest capacity of the arrays. A copied vector doesn't
+    // keep its capacity, so a copied pool grows on its first shot.
+    auto capacity() const -> int;
+    auto reserve(int capacity) -> void;
+
+    auto add(Position position, vec2 dir, int damage_, int tower_idx_, long long expire_tick_) -> int;
+
+    auto box(int slot) const -> Box {
+        return Box{Position{x[slot], y[slot]}, size_ndc, size_ndc};
+    }
+    auto interpolated_box(int slot, float alpha) const -> Box {
+        return Box{lerp(Position{prev_x[slot], prev_y[slot]}, Position{x[slot], y[slot]}, alpha), size_ndc, size_ndc};
+    }
+
+    // Marks the slot finished, it keeps its data until the next `compact`. Killing twice is a no-op.
+    auto kill(int slot) -> void {
+        if (!alive[slot]) return;
+        alive[slot] = 0;
+        dead_slots.push_back(slot);
+    }
+    auto compact() -> void;
+    auto clear() -> void;
+
+  private:
+    auto remove_slot(int slot) -> void;
+};
@@ -0,0 +1,201 @@
+/* danielsinkin97@gmail.com */
+
+#include "range_kernel.hpp"
+
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TD_RANGE_KERNEL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+// Compiles a single function for a wider ISA than the rest of the translation unit, only avx2 (not fma) so
+// the multiply and add stay separately rounded.
+#define TD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define TD_TARGET(isa)
+#endif
+
+auto range_kernel_scalar(const float *xs, const float *ys, int count, Position center, float radius, float *dist_out) -> RangeBlock {
+    RangeBlock block;
+    float best = std::numeric_limits<float>::infinity();
+    for (int i = 0; i < count; ++i) {
+        float dx = center.x - xs[i];
+        float dy = center.y - ys[i];
+        float dist = std::sqrt(dx * dx + dy * dy);
+        dist_out[i] = dist;
+        if (dist < radius) {
+            block.mask |= uint64_t{1} << i;
+            if (dist < best) {
+                best = dist;
+                block.closest = i;
+            }
+        }
+    }
+    block.closest_distance = best;
+    return block;
+}
+
+#ifdef TD_RANGE_KERNEL_X86
+// Finishes a block after the vector loop: the lanes' minima are merged (lowest index on ties) and the points
+// past the last full vector go through the scalar path.
+static auto finish_block(RangeBlock block, const float *lane_best, const float *lane_idx, int lanes,
+                         const float *xs, const float *ys, int start, int count, Position center, float radius,
+                         float *dist_out) -> RangeBlock {
+    float best = std::numeric_limits<float>::infinity();
+    for (int lane = 0; lane < lanes; ++lane) {
+        int idx = static_cast<int>(lane_idx[lane]);
+        if (lane_best[lane] < best || (lane_best[lane] == best && idx < block.closest)) {
+            best = lane_best[lane];
+            block.closest = idx;
+        }
+    }
+    for (int i = start; i < count; ++i) {
+        float dx = center.x - xs[i];
+        float dy = center.y - ys[i];
+        float dist = std::sqrt(dx * dx + dy * dy);
+        dist_out[i] = dist;
+        if (dist < radius) {
+            block.mask |= uint64_t{1} << i;
+            if (dist < best) {
+                best = dist;
+                block.closest = i;
+            }
+        }
+    }
+    block.closest_distance = best;
+    return block;
+}
+
+static auto range_kernel_sse2(const float *xs, const float *ys, int count, Position center, float radius, float *dist_out) -> RangeBlock {
+    RangeBlock block;
+    const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    const __m128 cx = _mm_set1_ps(center.x);
+    const __m128 cy = _mm_set1_ps(center.y);
+    const __m128 r = _mm_set1_ps(radius);
+    const __m128 step = _mm_set1_ps(4.0f);
+    __m128 idx = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    __m128 best = inf;
+    __m128 best_idx = _mm_setzero_ps();
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 dx = _mm_sub_ps(cx, _mm_loadu_ps(xs + i));
+        __m128 dy = _mm_sub_ps(cy, _mm_loadu_ps(ys + i));
+        __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+        _mm_storeu_ps(dist_out + i, dist);
+        __m128 in_range = _mm_cmplt_ps(dist, r);
+        block.mask |= static_cast<uint64_t>(_mm_movemask_ps(in_range)) << i;
+        // SSE2 has no blend, select with and/andnot/or
+        __m128 candidate = _mm_or_ps(_mm_and_ps(in_range, dist), _mm_andnot_ps(in_range, inf));
+        __m128 closer = _mm_cmplt_ps(candidate, best);
+        best = _mm_or_ps(_mm_and_ps(closer, candidate), _mm_andnot_ps(closer, best));
+        best_idx = _mm_or_ps(_mm_and_ps(closer, idx), _mm_andnot_ps(closer, best_idx));
+        idx = _mm_add_ps(idx, step);
+    }
+
+    alignas(16) float lane_best[4];
+    alignas(16) float lane_idx[4];
+    _mm_store_ps(lane_best, best);
+    _mm_store_ps(lane_idx, best_idx);
+    return finish_block(block, lane_best, lane_idx, 4, xs, ys, i, count, center, radius, dist_out);
+}
+
+TD_TARGET("avx2")
+static auto range_kernel_avx2(const float *xs, const float *ys, int count, Position center, float radius, float *dist_out) -> RangeBlock {
+    RangeBlock block;
+    const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    const __m256 cx = _mm256_set1_ps(center.x);
+    const __m256 cy = _mm256_set1_ps(center.y);
+    const __m256 r = _mm256_set1_ps(radius);
+    const __m256 step = _mm256_set1_ps(8.0f);
+    __m256 idx = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    __m256 best = inf;
+    __m256 best_idx = _mm256_setzero_ps();
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 dx = _mm256_sub_ps(cx, _mm256_loadu_ps(xs + i));
+        __m256 dy = _mm256_sub_ps(cy, _mm256_loadu_ps(ys + i));
+        __m256 dist = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+        _mm256_storeu_ps(dist_out + i, dist);
+        __m256 in_range = _mm256_cmp_ps(dist, r, _CMP_LT_OQ);
+        block.mask |= static_cast<uint64_t>(_mm256_movemask_ps(in_range)) << i;
+        __m256 candidate = _mm256_blendv_ps(inf, dist, in_range);
+        __m256 closer = _mm256_cmp_ps(candidate, best, _CMP_LT_OQ);
+        best = _mm256_blendv_ps(best, candidate, closer);
+        best_idx = _mm256_blendv_ps(best_idx, idx, closer);
+        idx = _mm256_add_ps(idx, step);
+    }
+
+    alignas(32) float lane_best[8];
+    alignas(32) float lane_idx[8];
+    _mm256_store_ps(lane_best, best);
+    _mm256_store_ps(lane_idx, best_idx);
+    return finish_block(block, lane_best, lane_idx, 8, xs, ys, i, count, center, radius, dist_out);
+}
+
+static auto cpu_has_avx2() -> bool {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuidex(info, 1, 0);
+    bool os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6;
+    __cpuidex(info, 7, 0);
+    return os_saves_ymm && (info[1] & (1 << 5));
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+auto range_kernel_isa_name(RangeKernelIsa isa) -> const char * {
+    switch (isa) {
+    case RangeKernelIsa::Scalar: return "scalar";
+    case RangeKernelIsa::SSE2: return "sse2";
+    case RangeKernelIsa::AVX2: return "avx2";
+    default: return "unknown";
+    }
+}
+
+auto range_kernel_isa_supported(RangeKernelIsa isa) -> bool {
+    switch (isa) {
+    case RangeKernelIsa::Scalar: return true;
+#ifdef TD_RANGE_KERNEL_X86
+    // SSE2 is part of x86-64
+    case RangeKernelIsa::SSE2: return true;
+    case RangeKernelIsa::AVX2: {
+        static const bool has_avx2 = cpu_has_avx2();
+        return has_avx2;
+    }
+#endif
+    default: return false;
+    }
+}
+
+auto best_range_kernel_isa() -> RangeKernelIsa {
+    static const RangeKernelIsa best = []() {
+        for (RangeKernelIsa isa : {RangeKernelIsa::AVX2, RangeKernelIsa::SSE2}) {
+            if (range_kernel_isa_supported(isa)) return isa;
+        }
+        return RangeKernelIsa::Scalar;
+    }();
+    return best;
+}
+
+auto range_kernel(RangeKernelIsa isa) -> RangeKernel {
+    if (!range_kernel_isa_supported(isa)) panic("Range kernel ISA not supported on this machine");
+    switch (isa) {
+#ifdef TD_RANGE_KERNEL_X86
+    case RangeKernelIsa::SSE2: return range_kernel_sse2;
+    case RangeKernelIsa::AVX2: return range_kernel_avx2;
+#endif
+    default: return range_kernel_scalar;
+    }
+}
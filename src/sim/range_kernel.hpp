@@ -0,0 +1,43 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include "common.hpp"
+
+#include <cstdint>
+
+/*
+Batch range test used by tower targeting. A kernel takes up to `range_kernel_block_size` points (packed x and
+y arrays), writes the distance of every point to the query center and returns which points are strictly
+within the radius together with the closest of those, all in one pass over the block.
+
+All variants compute sqrt(dx * dx + dy * dy) with the same rounding (no FMA), so they agree bit for bit with
+each other and with the scalar `distance` used elsewhere in the simulation. Ties on the closest distance go
+to the lowest index in the block.
+*/
+constexpr int range_kernel_block_size = 64;
+
+struct RangeBlock {
+    // Bit i is set if point i is in range
+    uint64_t mask = 0;
+    // Index of the closest point in range, -1 if none is
+    int closest = -1;
+    float closest_distance = 0.0f;
+};
+
+using RangeKernel = auto (*)(const float *xs, const float *ys, int count, Position center, float radius, float *dist_out) -> RangeBlock;
+
+enum class RangeKernelIsa {
+    Scalar,
+    SSE2,
+    AVX2,
+    NumRangeKernelIsa
+};
+
+auto range_kernel_isa_name(RangeKernelIsa isa) -> const char *;
+// Whether the variant was compiled in and the CPU we are running on supports it.
+auto range_kernel_isa_supported(RangeKernelIsa isa) -> bool;
+// Widest supported variant, detected once at startup.
+auto best_range_kernel_isa() -> RangeKernelIsa;
+auto range_kernel(RangeKernelIsa isa) -> RangeKernel;
+
+auto range_kernel_scalar(const float *xs, const float *ys, int count, Position center, float radius, float *dist_out) -> RangeBlock;
@@ -0,0 +1,148 @@
+/* danielsinkin97@gmail.com */
+
+#include "replay.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+struct ReplayHeader {
+    static constexpr char expected_magic[8] = {'T', 'D', 'R', 'E', 'P', 'L', 'A', 'Y'};
+    static constexpr uint32_t current_version = 1;
+
+    char magic[8];
+    uint32_t version;
+    int32_t tick_rate;
+    uint32_t use_flow_field;
+    uint32_t reserved;
+    uint64_t start_size;
+    uint64_t input_count;
+    uint64_t hash_count;
+};
+
+// On disk layout of a `RecordedInput`, independent of how `InputCommand` is laid out in memory
+struct InputRecord {
+    int64_t tick;
+    int32_t type;
+    float x;
+    float y;
+    uint32_t reserved;
+};
+
+template <typename T>
+auto append_bytes(std::vector<std::byte> &out, const T *data, size_t count) -> void {
+    size_t offset = out.size();
+    out.resize(offset + count * sizeof(T));
+    if (count != 0) std::memcpy(out.data() + offset, data, count * sizeof(T));
+}
+
+auto start_recording(const Simulation &sim, Replay &replay) -> void {
+    replay.tick_rate = sim.tick_rate;
+    replay.use_flow_field = sim.use_flow_field;
+    encode_snapshot(sim, replay.start);
+    replay.inputs.clear();
+    replay.hashes.clear();
+}
+
+auto save_replay(const Replay &replay, const std::string &path) -> bool {
+    ReplayHeader header{};
+    std::memcpy(header.magic, ReplayHeader::expected_magic, sizeof(header.magic));
+    header.version = ReplayHeader::current_version;
+    header.tick_rate = replay.tick_rate;
+    header.use_flow_field = replay.use_flow_field;
+    header.start_size = replay.start.size();
+    header.input_count = replay.inputs.size();
+    header.hash_count = replay.hashes.size();
+
+    std::vector<std::byte> out;
+    out.reserve(sizeof(header) + replay.start.size() + replay.inputs.size() * sizeof(InputRecord) +
+                replay.hashes.size() * sizeof(uint64_t));
+    append_bytes(out, &header, 1);
+    append_bytes(out, replay.start.data(), replay.start.size());
+    for (const RecordedInput &recorded : replay.inputs) {
+        InputRecord record{recorded.tick, static_cast<int32_t>(recorded.input.type), recorded.input.position.x,
+                           recorded.input.position.y, 0};
+        append_bytes(out, &record, 1);
+    }
+    append_bytes(out, replay.hashes.data(), replay.hashes.size());
+    return write_snapshot_file(path, out);
+}
+
+auto load_replay(Replay &replay, const std::string &path) -> bool {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to open replay " << path << "\n";
+        return false;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    ReplayHeader header;
+    if (data.size() < sizeof(header)) {
+        std::cerr << "Replay too short for its header\n";
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, ReplayHeader::expected_magic, sizeof(header.magic)) != 0 ||
+        header.version != ReplayHeader::current_version || header.tick_rate <= 0) {
+        std::cerr << "Not a replay of this version: " << path << "\n";
+        return false;
+    }
+    // Counts are checked one at a time, so their products below cannot overflow
+    uint64_t remaining = data.size() - sizeof(header);
+    if (header.start_size > remaining || header.input_count > remaining / sizeof(InputRecord) ||
+        header.hash_count > remaining / sizeof(uint64_t) ||
+        header.start_size + header.input_count * sizeof(InputRecord) + header.hash_count * sizeof(uint64_t) != remaining) {
+        std::cerr << "Replay size does not match its header\n";
+        return false;
+    }
+
+    Replay loaded;
+    loaded.tick_rate = header.tick_rate;
+    loaded.use_flow_field = header.use_flow_field != 0;
+    const char *cursor = data.data() + sizeof(header);
+    loaded.start.resize(header.start_size);
+    std::memcpy(loaded.start.data(), cursor, header.start_size);
+    cursor += header.start_size;
+    for (uint64_t i = 0; i < header.input_count; ++i) {
+        InputRecord record;
+        std::memcpy(&record, cursor, sizeof(record));
+        cursor += sizeof(record);
+        if (record.type < 0 || record.type >= static_cast<int32_t>(InputType::NumInputType) ||
+            (!loaded.inputs.empty() && record.tick < loaded.inputs.back().tick)) {
+            std::cerr << "Replay input " << i << " is invalid\n";
+            return false;
+        }
+        loaded.inputs.push_back(RecordedInput{record.tick, InputCommand{static_cast<InputType>(record.type), Position{record.x, record.y}}});
+    }
+    loaded.hashes.resize(header.hash_count);
+    if (header.hash_count != 0) std::memcpy(loaded.hashes.data(), cursor, header.hash_count * sizeof(uint64_t));
+
+    replay = std::move(loaded);
+    return true;
+}
+
+auto begin_replay(Simulation &sim, const Replay &replay) -> bool {
+    sim.tick_rate = replay.tick_rate;
+    sim.use_flow_field = replay.use_flow_field;
+    return decode_snapshot(replay.start.data(), replay.start.size(), sim);
+}
+
+auto run_replay(Simulation &sim, const Replay &replay) -> ReplayResult {
+    ReplayResult result;
+    size_t next_input = 0;
+    for (uint64_t expected : replay.hashes) {
+        while (next_input < replay.inputs.size() && replay.inputs[next_input].tick <= sim.tick) {
+            apply_input(sim, replay.inputs[next_input].input);
+            ++next_input;
+        }
+        long long tick = sim.tick;
+        tick_simulation(sim);
+        result.ticks += 1;
+        if (snapshot_hash(sim) != expected) {
+            result.diverged_tick = tick;
+            break;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,59 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include "snapshot.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+Recording of a session: the state it started from, every input with the tick it was applied on, and the
+`snapshot_hash` after every tick. The simulation only reads its tick counter and the inputs, so applying
+the same inputs on the same ticks to the same start state reproduces the session exactly, without any of
+the wall clock timing of the frames it was played in.
+
+A frontend calls `start_recording` once, `record_input` for every input it applies and `record_tick` after
+every tick. Replaying applies the inputs of a tick before ticking it, the same order `SimThread` uses.
+*/
+struct RecordedInput {
+    long long tick;
+    InputCommand input;
+};
+
+struct Replay {
+    int tick_rate = SimConstants::default_tick_rate;
+    bool use_flow_field = false;
+    // Encoded snapshot of the state the recording started from
+    std::vector<std::byte> start;
+    // Ordered by tick, inputs of the same tick in the order they were applied
+    std::vector<RecordedInput> inputs;
+    // State hash after each tick since the start
+    std::vector<uint64_t> hashes;
+};
+
+// Starts a new recording from the current state of `sim`, dropping whatever `replay` held.
+auto start_recording(const Simulation &sim, Replay &replay) -> void;
+inline auto record_input(const Simulation &sim, Replay &replay, const InputCommand &input) -> void {
+    replay.inputs.push_back(RecordedInput{sim.tick, input});
+}
+inline auto record_tick(const Simulation &sim, Replay &replay) -> void {
+    replay.hashes.push_back(snapshot_hash(sim));
+}
+
+auto save_replay(const Replay &replay, const std::string &path) -> bool;
+// Returns false (leaving `replay` untouched) if the file is not a valid replay.
+auto load_replay(Replay &replay, const std::string &path) -> bool;
+
+// Puts `sim` into the configuration and start state of the recording.
+auto begin_replay(Simulation &sim, const Replay &replay) -> bool;
+
+struct ReplayResult {
+    long long ticks = 0;
+    // First tick whose state hash differs from the recording, -1 if none did
+    long long diverged_tick = -1;
+};
+// Ticks through the whole recording from where `begin_replay` left `sim`, as fast as possible, and stops at
+// the first divergence.
+auto run_replay(Simulation &sim, const Replay &replay) -> ReplayResult;
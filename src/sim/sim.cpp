@@ -0,0 +1,440 @@
+/* danielsinkin97@gmail.com */
+
+#include "sim.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <limits>
+
+auto init_tower(Simulation &sim, Tower &tower) -> void {
+    tower.tick_of_last_shot = sim.tick;
+}
+auto init_flow_field(Simulation &sim) -> void {
+    FlowField &field = sim.flow_field;
+    field.reset();
+    field.add_goal(sim.path_markers.back());
+    for (const auto &tower : sim.game.towers) {
+        if (tower.is_active) field.add_blocker(tower.box);
+    }
+    field.rebuild();
+}
+auto init_simulation(Simulation &sim) -> void {
+    for (auto &tower : sim.game.towers) {
+        init_tower(sim, tower);
+    }
+    sim.game.projectiles.reserve(sim.projectile_capacity);
+    init_flow_field(sim);
+    sim.target_drift = std::numeric_limits<float>::infinity();
+    EnemyStore &enemies = sim.game.enemies;
+    enemies.prev_x = enemies.x;
+    enemies.prev_y = enemies.y;
+}
+
+auto default_enemies() -> EnemyStore {
+    struct Spawn {
+        Position position;
+        int hp;
+        int hp_max;
+    };
+    const Spawn spawns[] = {
+        {Position{0.441f, 0.467f}, 100, 100},
+        {Position{0.271f, 0.768f}, 250, 500},
+        {Position{0.668f, 0.160f}, 300, 300},
+        {Position{0.339844f, 0.452778f}, 300, 300},
+        {Position{0.386719f, 0.255556f}, 300, 300},
+        {Position{0.514063f, 0.126389f}, 300, 300},
+        {Position{0.760156f, 0.658333f}, 300, 300},
+        {Position{0.721875f, 0.851389f}, 300, 300},
+        {Position{0.49375f, 0.866667f}, 300, 300},
+        {Position{0.464844f, 0.690278f}, 300, 300}};
+
+    EnemyStore enemies;
+    for (const Spawn &spawn : spawns) {
+        enemies.add(Box{window_normalized_to_ndc(spawn.position), 0.05f, 0.05f}, spawn.hp, spawn.hp_max);
+    }
+    return enemies;
+}
+
+auto spawn_tower_at_position(Simulation &sim, const Position &position) -> void {
+    auto box = Box{position, 0.1f, 0.1f};
+    int tower_id = sim.game.towers.size();
+    auto tower = Tower{tower_id, true, TowerType::Fire, box, 0};
+    init_tower(sim, tower);
+    sim.game.towers.push_back(tower);
+    sim.flow_field.add_blocker(box);
+}
+
+auto spawn_enemy_at_position(Simulation &sim, const Position &position) -> EnemyId {
+    sim.target_drift = std::numeric_limits<float>::infinity();
+    return sim.game.enemies.add(Box{position, 0.05f, 0.05f}, SimConstants::enemy_hp, SimConstants::enemy_hp);
+}
+
+auto apply_input(Simulation &sim, const InputCommand &input) -> void {
+    switch (input.type) {
+    case InputType::SpawnEnemy:
+        spawn_enemy_at_position(sim, input.position);
+        break;
+    case InputType::SpawnTower:
+        spawn_tower_at_position(sim, input.position);
+        break;
+    case InputType::DisableTowerAt:
+        for (auto &tower : sim.game.towers) {
+            if (tower.is_active && tower.box.is_point_inside(input.position)) {
+                tower.is_active = false;
+                sim.flow_field.remove_blocker(tower.box);
+            }
+        }
+        break;
+    case InputType::CycleTargetingAt:
+        for (auto &tower : sim.game.towers) {
+            if (tower.box.is_point_inside(input.position)) tower.targeting = next_targeting_policy(tower.targeting);
+        }
+        break;
+    default:
+        panic("Unknown input type");
+        break;
+    }
+}
+
+auto place_enemy_on_path(Simulation &sim, int slot, float progress) -> void {
+    EnemyStore &enemies = sim.game.enemies;
+    Position position = sim.path.position_at(progress);
+    enemies.progress[slot] = progress;
+    enemies.x[slot] = position.x;
+    enemies.y[slot] = position.y;
+    // Teleport, don't interpolate from wherever the enemy was
+    enemies.prev_x[slot] = position.x;
+    enemies.prev_y[slot] = position.y;
+    sim.target_drift = std::numeric_limits<float>::infinity();
+}
+
+auto spawn_enemies_along_path(Simulation &sim, int count, int hp) -> void {
+    float spacing = sim.path.length / static_cast<float>(count);
+    float size = std::min(0.05f, spacing / 4.0f);
+    EnemyStore &enemies = sim.game.enemies;
+    for (int i = 0; i < count; ++i) {
+        spawn_enemy_at_position(sim, sim.path_markers.front().position);
+        int slot = enemies.size() - 1;
+        enemies.w[slot] = size;
+        enemies.h[slot] = size;
+        enemies.hp[slot] = hp;
+        enemies.hp_max[slot] = hp;
+        place_enemy_on_path(sim, slot, spacing * static_cast<float>(i));
+    }
+}
+
+auto leak_enemy(Simulation &sim, int slot) -> void {
+    EnemyStore &enemies = sim.game.enemies;
+    sim.game.life -= 1;
+    place_enemy_on_path(sim, slot, 0.0f);
+    enemies.hp[slot] = enemies.hp_max[slot];
+}
+
+auto on_tick_enemy_flow_field(Simulation &sim, int slot) -> void {
+    EnemyStore &enemies = sim.game.enemies;
+    const FlowField &field = sim.flow_field;
+    Position center = enemies.center(slot);
+    int cell = field.cell_of(center);
+    if (field.is_goal(cell)) {
+        leak_enemy(sim, slot);
+        return;
+    }
+    enemies.progress[slot] = field.progress_at(cell);
+
+    // Walled in enemies wait until a tower is removed
+    int next = field.next_cell(cell);
+    if (next == -1) return;
+    vec2 to_next = field.cell_center(next) - center;
+    float remaining = glm::length(to_next);
+    if (remaining <= 0.0f) return;
+    float step = std::min(SimConstants::enemy_speed * sim.dt(), remaining);
+    enemies.x[slot] += to_next.x * (step / remaining);
+    enemies.y[slot] += to_next.y * (step / remaining);
+}
+
+auto on_tick_enemy_path(Simulation &sim, int slot) -> void {
+    EnemyStore &enemies = sim.game.enemies;
+    if (enemies.progress[slot] < 0.0f) {
+        place_enemy_on_path(sim, slot, sim.path.project(Position{enemies.x[slot], enemies.y[slot]}));
+    }
+
+    float progress = enemies.progress[slot] + SimConstants::enemy_speed * sim.dt();
+    if (progress >= sim.path.length) {
+        leak_enemy(sim, slot);
+        return;
+    }
+    Position position = sim.path.position_at(progress);
+    enemies.progress[slot] = progress;
+    enemies.x[slot] = position.x;
+    enemies.y[slot] = position.y;
+}
+
+auto on_tick_enemies(Simulation &sim) -> void {
+    TD_PROFILE_ZONE("on_tick_enemies");
+    EnemyStore &enemies = sim.game.enemies;
+    for (int slot = 0; slot < enemies.size(); ++slot) {
+        if (sim.use_flow_field) {
+            on_tick_enemy_flow_field(sim, slot);
+        } else {
+            on_tick_enemy_path(sim, slot);
+        }
+        if (enemies.hp[slot] <= 0) enemies.kill(slot);
+    }
+    // Both ways of moving take at most one step, a chord of the path is never longer than its arc
+    sim.target_drift += SimConstants::enemy_speed * sim.dt();
+}
+
+auto kill_enemy(Simulation &sim, int slot) -> void {
+    sim.game.enemies.kill(slot);
+    // The grid only knows the slots it was rebuilt with
+    if (sim.use_spatial_grid && slot < static_cast<int>(sim.enemy_grid.slot_entry.size())) {
+        sim.enemy_grid.remove(slot);
+    }
+}
+
+auto damage_enemy(Simulation &sim, int slot, int amount) -> void {
+    sim.game.enemies.hp[slot] -= amount;
+    if (sim.game.enemies.hp[slot] <= 0) kill_enemy(sim, slot);
+}
+
+auto absorb_enemy(EnemyStore &enemies, int survivor, int absorbed) -> void {
+    { // height
+        float big = std::max(enemies.h[survivor], enemies.h[absorbed]);
+        float small = std::min(enemies.h[survivor], enemies.h[absorbed]);
+        enemies.h[survivor] = big + small / 5.0f;
+    }
+    { // width
+        float big = std::max(enemies.w[survivor], enemies.w[absorbed]);
+        float small = std::min(enemies.w[survivor], enemies.w[absorbed]);
+        enemies.w[survivor] = big + small / 5.0f;
+    }
+    { // max HP
+        int big = std::max(enemies.hp_max[survivor], enemies.hp_max[absorbed]);
+        int small = std::min(enemies.hp_max[survivor], enemies.hp_max[absorbed]);
+        enemies.hp_max[survivor] = big + small / 5.0f;
+    }
+    { // current HP
+        int big = std::max(enemies.hp[survivor], enemies.hp[absorbed]);
+        int small = std::min(enemies.hp[survivor], enemies.hp[absorbed]);
+        enemies.hp[survivor] = big + small / 5.0f;
+        if (enemies.hp[survivor] > enemies.hp_max[survivor])
+            enemies.hp[survivor] = enemies.hp_max[survivor];
+    }
+
+    enemies.kill(absorbed);
+}
+
+auto merge_overlapping_enemies(Simulation &sim) -> void {
+    TD_PROFILE_ZONE("merge_overlapping_enemies");
+    EnemyStore &enemies = sim.game.enemies;
+    sim.merge_broadphase.find_overlapping_pairs(enemies, sim.merge_pairs);
+    // Pairs come sorted by (first, second): the lowest slot absorbs everything it touches and an enemy
+    // that was absorbed (or died while moving) takes no further part in this tick.
+    // Growing moves the survivor's center, which counts towards the target drift like movement does.
+    int survivor = -1;
+    Position survivor_center;
+    float max_shift = 0.0f;
+    for (const OverlapPair &pair : sim.merge_pairs) {
+        if (!enemies.alive[pair.first] || !enemies.alive[pair.second]) continue;
+        if (pair.first != survivor) {
+            survivor = pair.first;
+            survivor_center = enemies.center(survivor);
+        }
+        absorb_enemy(enemies, pair.first, pair.second);
+        max_shift = std::max(max_shift, distance(survivor_center, enemies.center(survivor)));
+    }
+    sim.target_drift += max_shift;
+    enemies.compact();
+}
+
+auto shoot_at(Simulation &sim, Tower &tower, Position pos) -> void {
+    Position center = tower.box.get_center();
+    vec2 dir = glm::normalize(pos - center);
+    long long expire_tick = sim.tick + sim.seconds_to_ticks(SimConstants::projectile_life_time);
+    int damage = static_cast<int>(sim.table_tower_damage[tower.level]);
+    sim.game.projectiles.add(center, dir, damage, tower.id, expire_tick);
+    tower.tick_of_last_shot = sim.tick;
+}
+
+auto on_tick_projectile(const Simulation &sim, int slot, ProjectileStore &projectiles, ProjectileCommands &commands) -> void {
+    if (sim.tick >= projectiles.expire_tick[slot]) {
+        commands.finished.push_back(slot);
+        return;
+    }
+    float step = SimConstants::projectile_speed * sim.dt();
+    projectiles.x[slot] += step * projectiles.dir_x[slot];
+    projectiles.y[slot] += step * projectiles.dir_y[slot];
+
+    // The lowest slot wins when several enemies are hit at once, same as a scan in slot order
+    const EnemyStore &enemies = sim.game.enemies;
+    Box box = projectiles.box(slot);
+    int hit_slot = -1;
+    if (sim.use_spatial_grid) {
+        sim.enemy_grid.for_each_overlapping(box, [&](int enemy_slot) {
+            if (hit_slot == -1 || enemy_slot < hit_slot) hit_slot = enemy_slot;
+        });
+    } else {
+        for (int enemy_slot = 0; enemy_slot < enemies.size(); ++enemy_slot) {
+            if (!enemies.alive[enemy_slot]) continue;
+            if (collision_box_box(box, enemies.box(enemy_slot))) {
+                hit_slot = enemy_slot;
+                break;
+            }
+        }
+    }
+    if (hit_slot == -1) return;
+
+    commands.damage.push_back(DamageCommand{hit_slot, projectiles.damage[slot]});
+    commands.finished.push_back(slot);
+}
+
+auto collect_enemies_in_radius(const Simulation &sim, Position center, float radius, std::vector<EnemyInRange> &out) -> void {
+    out.clear();
+    const EnemyStore &enemies = sim.game.enemies;
+    sim.enemy_grid.for_each_block_in_radius(
+        center, radius,
+        [&](const int *slots, const float *distances, const RangeBlock &block) {
+            for (uint64_t bits = block.mask; bits != 0; bits &= bits - 1) {
+                int k = std::countr_zero(bits);
+                out.push_back(EnemyInRange{enemies.id[slots[k]], distances[k]});
+            }
+        });
+}
+
+auto collect_enemies_in_radius_brute_force(const Simulation &sim, Position center, float radius, std::vector<EnemyInRange> &out) -> void {
+    out.clear();
+    const EnemyStore &enemies = sim.game.enemies;
+    for (int slot = 0; slot < enemies.size(); ++slot) {
+        if (!enemies.alive[slot]) continue;
+        float dist = distance(center, enemies.center(slot));
+        if (dist < radius) out.push_back(EnemyInRange{enemies.id[slot], dist});
+    }
+}
+
+auto refresh_tower_targets(const Simulation &sim, Tower &tower) -> void {
+    // The in-range list is rebuilt by the next update anyway, so it doubles as the query buffer
+    std::vector<EnemyInRange> &found = tower.targets.in_range;
+    // The pad keeps rounding in the drift bound from losing an enemy right at the edge
+    float radius = sim.table_tower_range[tower.level] + SimConstants::target_skin + 1e-4f;
+    if (sim.use_spatial_grid) {
+        collect_enemies_in_radius(sim, tower.box.get_center(), radius, found);
+    } else {
+        collect_enemies_in_radius_brute_force(sim, tower.box.get_center(), radius, found);
+    }
+    tower.targets.refresh(found);
+}
+
+auto on_tick_tower(const Simulation &sim, Tower &tower, TowerCommands &commands) -> void {
+    if (!tower.is_active) return;
+
+    if (sim.refresh_targets || tower.targets.stale) refresh_tower_targets(sim, tower);
+    std::optional<EnemyId> target = tower.targets.update(sim.game.enemies, tower.box.get_center(),
+                                                         sim.table_tower_range[tower.level], tower.targeting);
+
+    long long tower_firing_delay = sim.seconds_to_ticks(sim.table_tower_firing_delay[tower.level]);
+    bool ready_to_shoot = (sim.tick - tower.tick_of_last_shot) >= tower_firing_delay;
+    if (ready_to_shoot) {
+        if (target) {
+            int slot = sim.game.enemies.slot_of(*target);
+            commands.shots.push_back(ShotCommand{tower.id, sim.game.enemies.center(slot)});
+        }
+    }
+}
+
+// Runs f(chunk, begin, end) for `chunk_count` consecutive ranges covering [0, count), on the pool if there is one.
+template <typename F>
+auto for_each_chunk(Simulation &sim, int count, int chunk_count, F &&f) -> void {
+    auto run_chunk = [&](int chunk) {
+        int begin = static_cast<int>(static_cast<long long>(count) * chunk / chunk_count);
+        int end = static_cast<int>(static_cast<long long>(count) * (chunk + 1) / chunk_count);
+        f(chunk, begin, end);
+    };
+    if (sim.thread_pool) {
+        // Through a reference, the lambda is too big for std::function's inline storage and would be
+        // allocated on every call
+        sim.thread_pool->parallel_for(chunk_count, std::ref(run_chunk));
+    } else {
+        run_chunk(0);
+    }
+}
+
+auto on_tick_towers(Simulation &sim) -> void {
+    TD_PROFILE_ZONE("on_tick_towers");
+    // One command buffer per chunk of consecutive towers (projectiles), so concatenating them in chunk order
+    // gives tower (projectile) order no matter how many chunks there are or which thread ran which.
+    int chunk_count = sim.thread_pool ? sim.thread_pool->thread_count() : 1;
+    if (static_cast<int>(sim.tower_commands.size()) < chunk_count) sim.tower_commands.resize(chunk_count);
+    if (static_cast<int>(sim.projectile_commands.size()) < chunk_count) sim.projectile_commands.resize(chunk_count);
+    // The candidates hold everything within `target_skin` of the range as of the last refresh
+    sim.refresh_targets = sim.target_drift > SimConstants::target_skin;
+    if (sim.refresh_targets) {
+        sim.target_drift = 0.0f;
+        sim.target_refreshes += 1;
+    }
+
+    for_each_chunk(sim, static_cast<int>(sim.game.towers.size()), chunk_count, [&](int chunk, int begin, int end) {
+        TD_PROFILE_ZONE("tower chunk");
+        TowerCommands &commands = sim.tower_commands[chunk];
+        commands.shots.clear();
+        // At most one shot per tower, so a chunk's buffer only ever grows with the tower count
+        commands.shots.reserve(end - begin);
+        for (int tower_idx = begin; tower_idx < end; ++tower_idx) {
+            on_tick_tower(sim, sim.game.towers[tower_idx], commands);
+        }
+    });
+    // Every chunk only writes the positions of its own projectiles
+    ProjectileStore &projectiles = sim.game.projectiles;
+    for_each_chunk(sim, projectiles.size(), chunk_count, [&](int chunk, int begin, int end) {
+        TD_PROFILE_ZONE("projectile chunk");
+        ProjectileCommands &commands = sim.projectile_commands[chunk];
+        commands.damage.clear();
+        commands.finished.clear();
+        // Sized by the pool rather than the chunk, whose share of the projectiles changes every tick
+        commands.damage.reserve(projectiles.capacity());
+        commands.finished.reserve(projectiles.capacity());
+        for (int slot = begin; slot < end; ++slot) {
+            on_tick_projectile(sim, slot, projectiles, commands);
+        }
+    });
+
+    for (int chunk = 0; chunk < chunk_count; ++chunk) {
+        const ProjectileCommands &commands = sim.projectile_commands[chunk];
+        for (const DamageCommand &damage : commands.damage) {
+            // Several projectiles can hit an enemy that the first of them already killed
+            if (sim.game.enemies.alive[damage.slot]) damage_enemy(sim, damage.slot, damage.amount);
+        }
+        for (int slot : commands.finished) {
+            projectiles.kill(slot);
+        }
+    }
+    // Before firing, so new projectiles are appended behind the surviving ones
+    projectiles.compact();
+    for (int chunk = 0; chunk < chunk_count; ++chunk) {
+        for (const ShotCommand &shot : sim.tower_commands[chunk].shots) {
+            shoot_at(sim, sim.game.towers[shot.tower_idx], shot.target);
+        }
+    }
+}
+
+auto tick_simulation(Simulation &sim) -> void {
+    TD_PROFILE_ZONE("tick_simulation");
+    EnemyStore &enemies = sim.game.enemies;
+    enemies.prev_x = enemies.x;
+    enemies.prev_y = enemies.y;
+    ProjectileStore &projectiles = sim.game.projectiles;
+    projectiles.prev_x = projectiles.x;
+    projectiles.prev_y = projectiles.y;
+
+    on_tick_enemies(sim);
+    // Also compacts, so the grid below is built over live enemies only
+    merge_overlapping_enemies(sim);
+    if (sim.use_spatial_grid) {
+        TD_PROFILE_ZONE("enemy_grid.rebuild");
+        sim.enemy_grid.rebuild(enemies);
+    }
+    on_tick_towers(sim);
+    enemies.compact();
+    sim.tick += 1;
+}
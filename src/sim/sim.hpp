@@ -0,0 +1,221 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include "broadphase.hpp"
+#include "common.hpp"
+#include "enemy_store.hpp"
+#include "flow_field.hpp"
+#include "path.hpp"
+#include "projectile_store.hpp"
+#include "spatial_grid.hpp"
+#include "targeting.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+enum class TowerType {
+    Fire,
+    Ice,
+    Buff,
+    NumTowerType
+};
+struct Tower {
+    int id;
+    bool is_active;
+    TowerType type;
+    Box box;
+    int level;
+    TargetingPolicy targeting = TargetingPolicy::Closest;
+    TargetTracker targets{};
+    long long tick_of_last_shot = 0;
+};
+
+// Effects of the tower and projectile read phases, recorded by the workers and applied afterwards in order.
+struct ShotCommand {
+    int tower_idx;
+    Position target;
+};
+struct TowerCommands {
+    std::vector<ShotCommand> shots;
+};
+struct DamageCommand {
+    int slot;
+    int amount;
+};
+struct ProjectileCommands {
+    std::vector<DamageCommand> damage;
+    // Projectile slots that hit or expired
+    std::vector<int> finished;
+};
+
+// The ten enemies every game starts with.
+auto default_enemies() -> EnemyStore;
+
+struct GameState {
+    int score = 0;
+    int life = 10;
+
+    EnemyStore enemies = default_enemies();
+    ProjectileStore projectiles;
+
+    std::vector<Tower> towers = {
+        Tower{0, true, TowerType::Fire, Box{window_normalized_to_ndc(Position{0.146f, 0.516f}), 0.1f, 0.1f}, 1},
+        Tower{1, true, TowerType::Ice, Box{window_normalized_to_ndc(Position{0.827f, 0.276f}), 0.1f, 0.1f}, 3},
+        Tower{2, true, TowerType::Buff, Box{window_normalized_to_ndc(Position{0.55f, 0.400f}), 0.1f, 0.1f}, 4}};
+};
+
+/*
+Everything a tick reads or writes. The game keeps one of these inside `Global`, the headless targets own
+their own instances, so nothing in here may refer to the window, GL or ImGui state.
+*/
+struct Simulation {
+    // Ticks per simulated second, fixed for the lifetime of the simulation (set it before `init_simulation`).
+    int tick_rate = SimConstants::default_tick_rate;
+    // Number of ticks simulated so far, this is the only clock the simulation reads.
+    long long tick = 0;
+
+    auto dt() const -> float { return 1.0f / static_cast<float>(tick_rate); }
+    auto seconds_to_ticks(float seconds) const -> long long {
+        return std::llround(static_cast<double>(seconds) * tick_rate);
+    }
+
+    // Index into those with the tower level
+    std::array<float, SimConstants::max_tower_level> table_tower_range = {0.25f, 0.3f, 0.35f, 0.4f, 0.45f};
+    std::array<float, SimConstants::max_tower_level> table_tower_damage = {5, 10, 20, 40, 50};
+    std::array<float, SimConstants::max_tower_level> table_tower_firing_delay = {1.0f, 0.9f, 0.8f, 0.7f, 0.5f};
+
+    std::array<Box, 15>
+        path_markers = {
+            Box{window_normalized_to_ndc(Position{0.131f, 0.931f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.133f, 0.729f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.173f, 0.573f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.243f, 0.436f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.350f, 0.204f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.411f, 0.163f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.441f, 0.227f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.477f, 0.355f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.524f, 0.583f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.596f, 0.820f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.667f, 0.786f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.710f, 0.558f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.716f, 0.368f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.774f, 0.226f}), SimConstants::path_marker_width, SimConstants::path_marker_height},
+            Box{window_normalized_to_ndc(Position{0.939f, 0.166f}), SimConstants::path_marker_width, SimConstants::path_marker_height}};
+    // Polyline through the markers, enemies move along it by arc length
+    PathPolyline path{path_markers};
+
+    // Distance to the last path marker around the active towers, repaired whenever a tower is placed or
+    // disabled. Enemies follow it instead of the path when `use_flow_field` is set (before `init_simulation`).
+    FlowField flow_field;
+    bool use_flow_field = false;
+
+    GameState game;
+    // Whatever the last snapshot load swapped out of `game`, the next load decodes into its arrays instead of
+    // allocating new ones. `load_listed` is scratch of the handle check.
+    GameState load_scratch;
+    std::vector<uint8_t> load_listed;
+
+    // Rebuilt after the enemy pass of every tick, towers query it instead of scanning all enemies
+    SpatialGrid enemy_grid;
+    bool use_spatial_grid = true;
+
+    // Upper bound on how far any enemy center moved since the towers last refreshed their target candidates,
+    // infinity after an enemy spawned or teleported. Towers refresh once it exceeds `target_skin`.
+    float target_drift = std::numeric_limits<float>::infinity();
+    // Set by `on_tick_towers` for the read phase
+    bool refresh_targets = false;
+    long long target_refreshes = 0;
+
+    // Scratch state of the merge broadphase, kept between ticks to avoid reallocating and resorting
+    SweepAndPrune merge_broadphase;
+    std::vector<OverlapPair> merge_pairs;
+
+    // Runs the tower read phase when set (not owned), the result is the same for any number of threads
+    ThreadPool *thread_pool = nullptr;
+    // One command buffer per chunk of towers and of projectiles, kept between ticks to avoid reallocating
+    std::vector<TowerCommands> tower_commands;
+    std::vector<ProjectileCommands> projectile_commands;
+
+    // Projectile pool size reserved by `init_simulation`, the pool grows past it when needed
+    int projectile_capacity = SimConstants::default_projectile_capacity;
+};
+
+// Player actions. Frontends queue them and the simulation applies them between ticks, so input never touches
+// the simulation while a tick runs on another thread.
+enum class InputType {
+    SpawnEnemy,
+    SpawnTower,
+    // Disables every tower containing the position
+    DisableTowerAt,
+    // Switches every tower containing the position to the next targeting policy
+    CycleTargetingAt,
+    NumInputType
+};
+struct InputCommand {
+    InputType type;
+    Position position;
+};
+
+auto init_tower(Simulation &sim, Tower &tower) -> void;
+// Full rebuild of the flow field from the path end and the active towers, later changes are repaired.
+auto init_flow_field(Simulation &sim) -> void;
+auto init_simulation(Simulation &sim) -> void;
+
+auto spawn_tower_at_position(Simulation &sim, const Position &position) -> void;
+auto spawn_enemy_at_position(Simulation &sim, const Position &position) -> EnemyId;
+
+auto apply_input(Simulation &sim, const InputCommand &input) -> void;
+
+// Puts the enemy at `progress` along the path without interpolating from its old position.
+auto place_enemy_on_path(Simulation &sim, int slot, float progress) -> void;
+// `count` enemies evenly spread over the path and small enough not to touch, so they never merge.
+auto spawn_enemies_along_path(Simulation &sim, int count, int hp) -> void;
+// The enemy walked off the end of the path: costs a life and sends it back to the start at full health.
+auto leak_enemy(Simulation &sim, int slot) -> void;
+// Moves the enemy one tick along the path, enemies that are not on the path yet first snap to the closest
+// point of it.
+auto on_tick_enemy_path(Simulation &sim, int slot) -> void;
+// Moves the enemy one step towards the next flow field cell, leaks it once it reached a goal cell.
+auto on_tick_enemy_flow_field(Simulation &sim, int slot) -> void;
+// Moves every enemy one tick along the path or, with `use_flow_field`, down the flow field.
+auto on_tick_enemies(Simulation &sim) -> void;
+
+// Marks the enemy dead and takes it out of the grid, the slot is removed at the next compaction.
+auto kill_enemy(Simulation &sim, int slot) -> void;
+auto damage_enemy(Simulation &sim, int slot, int amount) -> void;
+
+// Folds `absorbed` into `survivor` (bigger stat plus a fifth of the smaller one) and kills `absorbed`.
+auto absorb_enemy(EnemyStore &enemies, int survivor, int absorbed) -> void;
+// Runs after all enemies moved: finds overlapping pairs with the broadphase and applies them in pair order.
+auto merge_overlapping_enemies(Simulation &sim) -> void;
+
+// Fires a projectile from the tower center towards `pos`.
+auto shoot_at(Simulation &sim, Tower &tower, Position pos) -> void;
+/*
+Moves the projectile and records a hit or its expiry instead of applying it. Projectiles belong to the pool,
+not to their tower: they keep flying and hit with the damage they were fired with after their tower was
+disabled.
+*/
+auto on_tick_projectile(const Simulation &sim, int slot, ProjectileStore &projectiles, ProjectileCommands &commands) -> void;
+
+// Both fill `out` with the live enemies whose center is strictly closer than `radius` to `center`. The grid
+// version needs `sim.enemy_grid` to be up to date and runs the SIMD range kernel, the brute force version is
+// kept for benchmarking and cross-checking.
+auto collect_enemies_in_radius(const Simulation &sim, Position center, float radius, std::vector<EnemyInRange> &out) -> void;
+auto collect_enemies_in_radius_brute_force(const Simulation &sim, Position center, float radius, std::vector<EnemyInRange> &out) -> void;
+// Reruns the range query for the tower's target candidates.
+auto refresh_tower_targets(const Simulation &sim, Tower &tower) -> void;
+// Read phase of one tower: only writes the tower itself, everything else goes into `commands`.
+auto on_tick_tower(const Simulation &sim, Tower &tower, TowerCommands &commands) -> void;
+// Runs the read phase of all towers and then of all projectiles (on `sim.thread_pool` if set), then applies
+// the recorded damage in projectile order, removes finished projectiles and fires the new shots in tower
+// order. Decides beforehand whether the towers have to refresh their target candidates.
+auto on_tick_towers(Simulation &sim) -> void;
+
+// Runs one full tick: enemy movement, enemy merging, then all towers and projectiles, then
+// compacts the enemy store and advances `sim.tick`.
+auto tick_simulation(Simulation &sim) -> void;
@@ -0,0 +1,458 @@
+/* danielsinkin97@gmail.com */
+
+#include "snapshot.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+using json = nlohmann::json;
+
+// Calls f(group, name, array, length) for every store array in snapshot order, `length` is what the header
+// says the array holds. Binary and JSON, saving and loading all go through this list.
+template <typename Game, typename F>
+auto snapshot_arrays(Game &game, const SnapshotHeader &header, F &&f) -> void {
+    auto &enemies = game.enemies;
+    f("enemies", "x", enemies.x, header.enemy_count);
+    f("enemies", "y", enemies.y, header.enemy_count);
+    f("enemies", "w", enemies.w, header.enemy_count);
+    f("enemies", "h", enemies.h, header.enemy_count);
+    f("enemies", "prev_x", enemies.prev_x, header.enemy_count);
+    f("enemies", "prev_y", enemies.prev_y, header.enemy_count);
+    f("enemies", "hp", enemies.hp, header.enemy_count);
+    f("enemies", "hp_max", enemies.hp_max, header.enemy_count);
+    f("enemies", "progress", enemies.progress, header.enemy_count);
+    f("enemies", "id", enemies.id, header.enemy_count);
+    f("enemies", "alive", enemies.alive, header.enemy_count);
+    f("enemies", "slot_of_index", enemies.slot_of_index, header.enemy_index_count);
+    f("enemies", "generation", enemies.generation, header.enemy_index_count);
+    f("enemies", "free_indices", enemies.free_indices, header.enemy_free_count);
+
+    auto &projectiles = game.projectiles;
+    f("projectiles", "x", projectiles.x, header.projectile_count);
+    f("projectiles", "y", projectiles.y, header.projectile_count);
+    f("projectiles", "prev_x", projectiles.prev_x, header.projectile_count);
+    f("projectiles", "prev_y", projectiles.prev_y, header.projectile_count);
+    f("projectiles", "dir_x", projectiles.dir_x, header.projectile_count);
+    f("projectiles", "dir_y", projectiles.dir_y, header.projectile_count);
+    f("projectiles", "damage", projectiles.damage, header.projectile_count);
+    f("projectiles", "tower_idx", projectiles.tower_idx, header.projectile_count);
+    f("projectiles", "expire_tick", projectiles.expire_tick, header.projectile_count);
+    f("projectiles", "alive", projectiles.alive, header.projectile_count);
+}
+
+auto make_snapshot_header(const Simulation &sim) -> SnapshotHeader {
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SnapshotHeader::expected_magic, sizeof(header.magic));
+    header.version = SnapshotHeader::current_version;
+    header.byte_order = SnapshotHeader::byte_order_mark;
+    header.tick = sim.tick;
+    header.score = sim.game.score;
+    header.life = sim.game.life;
+    header.enemy_count = static_cast<uint32_t>(sim.game.enemies.size());
+    header.enemy_index_count = static_cast<uint32_t>(sim.game.enemies.slot_of_index.size());
+    header.enemy_free_count = static_cast<uint32_t>(sim.game.enemies.free_indices.size());
+    header.tower_count = static_cast<uint32_t>(sim.game.towers.size());
+    header.projectile_count = static_cast<uint32_t>(sim.game.projectiles.size());
+    return header;
+}
+
+// Size of a snapshot with the lengths in `header`, `game` is only needed for the array types.
+auto snapshot_size(const GameState &game, const SnapshotHeader &header) -> uint64_t {
+    uint64_t size = sizeof(SnapshotHeader) + uint64_t{header.tower_count} * sizeof(TowerRecord);
+    snapshot_arrays(game, header, [&](const char *, const char *, const auto &array, uint32_t length) {
+        size += uint64_t{length} * sizeof(array[0]);
+    });
+    return size;
+}
+
+auto tower_record(const Tower &tower) -> TowerRecord {
+    TowerRecord record{};
+    record.id = tower.id;
+    record.level = tower.level;
+    record.is_active = tower.is_active;
+    record.type = static_cast<uint8_t>(tower.type);
+    record.targeting = static_cast<uint8_t>(tower.targeting);
+    record.x = tower.box.position.x;
+    record.y = tower.box.position.y;
+    record.width = tower.box.width;
+    record.height = tower.box.height;
+    record.tick_of_last_shot = tower.tick_of_last_shot;
+    return record;
+}
+
+auto tower_record_valid(const TowerRecord &record) -> bool {
+    return record.type < static_cast<uint8_t>(TowerType::NumTowerType) &&
+           record.targeting < static_cast<uint8_t>(TargetingPolicy::NumTargetingPolicy) &&
+           record.level >= 0 && record.level < SimConstants::max_tower_level;
+}
+
+auto tower_from_record(const TowerRecord &record) -> Tower {
+    Box box{Position{record.x, record.y}, record.width, record.height};
+    Tower tower{record.id, record.is_active != 0, static_cast<TowerType>(record.type), box, record.level};
+    tower.targeting = static_cast<TargetingPolicy>(record.targeting);
+    tower.tick_of_last_shot = record.tick_of_last_shot;
+    return tower;
+}
+
+/*
+Checks everything that ticking the state uses as an index: tower ids are their position in `towers`,
+projectiles point at existing towers, and the enemy handle tables agree with each other. Every slot has to
+be alive (snapshots are taken between ticks, when the stores are compacted), its id has to resolve to the
+slot, and every other handle index has to be free and in the free list exactly once.
+*/
+auto game_state_valid(const GameState &game, std::vector<uint8_t> &listed) -> bool {
+    for (size_t idx = 0; idx < game.towers.size(); ++idx) {
+        if (game.towers[idx].id != static_cast<int>(idx)) {
+            std::cerr << "Snapshot tower " << idx << " has id " << game.towers[idx].id << "\n";
+            return false;
+        }
+    }
+    const ProjectileStore &projectiles = game.projectiles;
+    for (int slot = 0; slot < projectiles.size(); ++slot) {
+        if (projectiles.tower_idx[slot] < 0 || projectiles.tower_idx[slot] >= static_cast<int>(game.towers.size())) {
+            std::cerr << "Snapshot projectile " << slot << " was fired by tower " << projectiles.tower_idx[slot]
+                      << ", which does not exist\n";
+            return false;
+        }
+        if (projectiles.alive[slot] != 1) {
+            std::cerr << "Snapshot projectile " << slot << " is not alive\n";
+            return false;
+        }
+    }
+
+    const EnemyStore &enemies = game.enemies;
+    size_t index_count = enemies.slot_of_index.size();
+    if (index_count > size_t{EnemyStore::id_index_mask} + 1 || enemies.generation.size() != index_count) {
+        std::cerr << "Snapshot enemy handle table has " << index_count << " entries\n";
+        return false;
+    }
+    // One sequential pass: a used index has to hold the full id of its slot, so no two indices share a slot
+    // and once as many indices are used as there are slots, every slot's id resolves back to it
+    constexpr uint32_t max_generation = ~0u >> EnemyStore::id_index_bits;
+    size_t slot_count = enemies.id.size();
+    size_t used_count = 0;
+    bool handles_match = true;
+    for (size_t index = 0; index < index_count; ++index) {
+        uint32_t generation = enemies.generation[index];
+        handles_match &= generation <= max_generation;
+        int slot = enemies.slot_of_index[index];
+        if (slot == -1) continue;
+        EnemyId expected = (generation << EnemyStore::id_index_bits) | static_cast<uint32_t>(index);
+        handles_match &= slot >= 0 && static_cast<size_t>(slot) < slot_count && enemies.id[slot] == expected;
+        used_count += 1;
+    }
+    if (!handles_match || used_count != slot_count) {
+        std::cerr << "Snapshot enemy handles don't match the enemy ids\n";
+        return false;
+    }
+    if (std::any_of(enemies.alive.begin(), enemies.alive.end(), [](uint8_t alive) { return alive != 1; })) {
+        std::cerr << "Snapshot holds a dead enemy\n";
+        return false;
+    }
+    // Every index without a slot has to be in the free list, exactly once
+    listed.assign(index_count, 0);
+    for (uint32_t index : enemies.free_indices) {
+        if (index >= index_count || enemies.slot_of_index[index] != -1 || listed[index]) {
+            std::cerr << "Snapshot enemy free list holds handle " << index << ", which is not free\n";
+            return false;
+        }
+        listed[index] = 1;
+    }
+    if (enemies.free_indices.size() + used_count != index_count) {
+        std::cerr << "Snapshot enemy free list misses handles\n";
+        return false;
+    }
+    return true;
+}
+
+// Rebuilds what the snapshot leaves out from the freshly loaded game state.
+auto finish_snapshot_load(Simulation &sim) -> void {
+    EnemyStore &enemies = sim.game.enemies;
+    enemies.dead_slots.clear();
+    // Like `EnemyStore::add` does, so killing enemies of a loaded game doesn't allocate either
+    enemies.free_indices.reserve(enemies.slot_of_index.capacity());
+    enemies.dead_slots.reserve(enemies.slot_of_index.capacity());
+    sim.game.projectiles.dead_slots.clear();
+    sim.game.projectiles.reserve(std::max(sim.projectile_capacity, sim.game.projectiles.size()));
+    sim.merge_broadphase.order.clear();
+    init_flow_field(sim);
+    sim.target_drift = std::numeric_limits<float>::infinity();
+}
+
+auto encode_snapshot(const Simulation &sim, std::vector<std::byte> &out) -> void {
+    SnapshotHeader header = make_snapshot_header(sim);
+    header.total_size = snapshot_size(sim.game, header);
+    out.resize(header.total_size);
+
+    std::byte *cursor = out.data();
+    std::memcpy(cursor, &header, sizeof(header));
+    cursor += sizeof(header);
+    snapshot_arrays(sim.game, header, [&](const char *, const char *, const auto &array, uint32_t length) {
+        size_t bytes = size_t{length} * sizeof(array[0]);
+        if (bytes != 0) std::memcpy(cursor, array.data(), bytes);
+        cursor += bytes;
+    });
+    for (const Tower &tower : sim.game.towers) {
+        TowerRecord record = tower_record(tower);
+        std::memcpy(cursor, &record, sizeof(record));
+        cursor += sizeof(record);
+    }
+}
+
+auto decode_snapshot(const std::byte *data, size_t size, Simulation &sim) -> bool {
+    SnapshotHeader header;
+    if (size < sizeof(header)) {
+        std::cerr << "Snapshot too short for its header\n";
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, SnapshotHeader::expected_magic, sizeof(header.magic)) != 0) {
+        std::cerr << "Not a snapshot (bad magic)\n";
+        return false;
+    }
+    if (header.byte_order != SnapshotHeader::byte_order_mark) {
+        std::cerr << "Snapshot was written on a machine with the other byte order\n";
+        return false;
+    }
+    if (header.version != SnapshotHeader::current_version) {
+        std::cerr << "Snapshot version " << header.version << " is not supported (expected "
+                  << SnapshotHeader::current_version << ")\n";
+        return false;
+    }
+    // Every length comes from the header, so once the size matches no array can run past the end
+    if (header.total_size != size || snapshot_size(sim.game, header) != size) {
+        std::cerr << "Snapshot size does not match its header\n";
+        return false;
+    }
+    const std::byte *towers = data + size - size_t{header.tower_count} * sizeof(TowerRecord);
+    for (uint32_t i = 0; i < header.tower_count; ++i) {
+        TowerRecord record;
+        std::memcpy(&record, towers + size_t{i} * sizeof(record), sizeof(record));
+        if (!tower_record_valid(record)) {
+            std::cerr << "Snapshot tower " << i << " is invalid\n";
+            return false;
+        }
+    }
+
+    // Built up on the side, so a snapshot that fails the checks below leaves `sim` untouched
+    GameState &game = sim.load_scratch;
+    game.score = header.score;
+    game.life = header.life;
+    const std::byte *cursor = data + sizeof(header);
+    snapshot_arrays(game, header, [&](const char *, const char *, auto &array, uint32_t length) {
+        array.resize(length);
+        size_t bytes = size_t{length} * sizeof(array[0]);
+        if (bytes != 0) std::memcpy(array.data(), cursor, bytes);
+        cursor += bytes;
+    });
+    game.towers.clear();
+    for (uint32_t i = 0; i < header.tower_count; ++i) {
+        TowerRecord record;
+        std::memcpy(&record, towers + size_t{i} * sizeof(record), sizeof(record));
+        game.towers.push_back(tower_from_record(record));
+    }
+    if (!game_state_valid(game, sim.load_listed)) return false;
+
+    sim.tick = header.tick;
+    std::swap(sim.game, game);
+    finish_snapshot_load(sim);
+    return true;
+}
+
+auto write_snapshot_file(const std::string &path, const std::vector<std::byte> &data) -> bool {
+    std::string temporary_path = path + ".tmp";
+    int fd = ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        std::cerr << "Failed to open " << temporary_path << " for writing\n";
+        return false;
+    }
+    // One write for the whole snapshot, the loop only picks up after a short write
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t result = ::write(fd, data.data() + written, data.size() - written);
+        if (result <= 0) break;
+        written += static_cast<size_t>(result);
+    }
+    bool ok = ::close(fd) == 0 && written == data.size();
+    if (!ok || std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write snapshot " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Multiply-xorshift over 8 byte words, the tail is zero padded.
+auto hash_bytes(uint64_t hash, const void *data, size_t size) -> uint64_t {
+    auto mix = [&hash](uint64_t word) {
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+        hash ^= hash >> 32;
+    };
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    size_t offset = 0;
+    for (; offset + 8 <= size; offset += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + offset, 8);
+        mix(word);
+    }
+    if (offset < size) {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes + offset, size - offset);
+        mix(word);
+    }
+    mix(size);
+    return hash;
+}
+
+auto snapshot_hash(const Simulation &sim) -> uint64_t {
+    SnapshotHeader header = make_snapshot_header(sim);
+    uint64_t hash = hash_bytes(0, &header, sizeof(header));
+    snapshot_arrays(sim.game, header, [&](const char *, const char *, const auto &array, uint32_t length) {
+        hash = hash_bytes(hash, array.data(), size_t{length} * sizeof(array[0]));
+    });
+    for (const Tower &tower : sim.game.towers) {
+        TowerRecord record = tower_record(tower);
+        hash = hash_bytes(hash, &record, sizeof(record));
+    }
+    return hash;
+}
+
+auto save_snapshot(const Simulation &sim, const std::string &path, std::vector<std::byte> &buffer) -> bool {
+    encode_snapshot(sim, buffer);
+    return write_snapshot_file(path, buffer);
+}
+
+auto load_snapshot(Simulation &sim, const std::string &path) -> bool {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        std::cerr << "Failed to open snapshot " << path << "\n";
+        return false;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+        std::cerr << "Failed to read snapshot " << path << "\n";
+        ::close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map snapshot " << path << "\n";
+        return false;
+    }
+    bool ok = decode_snapshot(static_cast<const std::byte *>(mapping), size, sim);
+    ::munmap(mapping, size);
+    if (!ok) std::cerr << "Snapshot " << path << " was not loaded\n";
+    return ok;
+}
+
+auto export_snapshot_json(const Simulation &sim, const std::string &path) -> bool {
+    SnapshotHeader header = make_snapshot_header(sim);
+    json j;
+    j["version"] = header.version;
+    j["tick"] = header.tick;
+    j["score"] = header.score;
+    j["life"] = header.life;
+    snapshot_arrays(sim.game, header, [&](const char *group, const char *name, const auto &array, uint32_t) {
+        j[group][name] = array;
+    });
+    j["towers"] = json::array();
+    for (const Tower &tower : sim.game.towers) {
+        j["towers"].push_back({{"id", tower.id},
+                               {"is_active", tower.is_active},
+                               {"type", static_cast<int>(tower.type)},
+                               {"level", tower.level},
+                               {"targeting", targeting_policy_name(tower.targeting)},
+                               {"box", {tower.box.position.x, tower.box.position.y, tower.box.width, tower.box.height}},
+                               {"tick_of_last_shot", tower.tick_of_last_shot}});
+    }
+
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to open " << path << " for writing\n";
+        return false;
+    }
+    out << std::setw(2) << j << "\n";
+    return static_cast<bool>(out);
+}
+
+auto import_snapshot_json(Simulation &sim, const std::string &path) -> bool {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open " << path << " for reading\n";
+        return false;
+    }
+    // Built up on the side, so a broken file leaves `sim` untouched
+    GameState &game = sim.load_scratch;
+    long long tick;
+    try {
+        json j = json::parse(in);
+        if (j.at("version").get<uint32_t>() != SnapshotHeader::current_version) {
+            std::cerr << "JSON snapshot version is not supported\n";
+            return false;
+        }
+        tick = j.at("tick").get<long long>();
+        game.score = j.at("score").get<int>();
+        game.life = j.at("life").get<int>();
+
+        SnapshotHeader header{};
+        header.enemy_count = static_cast<uint32_t>(j.at("enemies").at("x").size());
+        header.enemy_index_count = static_cast<uint32_t>(j.at("enemies").at("slot_of_index").size());
+        header.enemy_free_count = static_cast<uint32_t>(j.at("enemies").at("free_indices").size());
+        header.projectile_count = static_cast<uint32_t>(j.at("projectiles").at("x").size());
+        bool lengths_match = true;
+        snapshot_arrays(game, header, [&](const char *group, const char *name, auto &array, uint32_t length) {
+            j.at(group).at(name).get_to(array);
+            lengths_match &= array.size() == length;
+        });
+        if (!lengths_match) {
+            std::cerr << "JSON snapshot arrays of one store differ in length\n";
+            return false;
+        }
+
+        game.towers.clear();
+        for (const json &entry : j.at("towers")) {
+            TowerRecord record{};
+            record.id = entry.at("id").get<int32_t>();
+            record.level = entry.at("level").get<int32_t>();
+            record.is_active = entry.at("is_active").get<bool>();
+            record.type = static_cast<uint8_t>(entry.at("type").get<int>());
+            record.targeting = static_cast<uint8_t>(TargetingPolicy::NumTargetingPolicy);
+            std::string targeting = entry.at("targeting").get<std::string>();
+            for (int policy = 0; policy < static_cast<int>(TargetingPolicy::NumTargetingPolicy); ++policy) {
+                if (targeting == targeting_policy_name(static_cast<TargetingPolicy>(policy))) record.targeting = static_cast<uint8_t>(policy);
+            }
+            const json &box = entry.at("box");
+            record.x = box.at(0).get<float>();
+            record.y = box.at(1).get<float>();
+            record.width = box.at(2).get<float>();
+            record.height = box.at(3).get<float>();
+            record.tick_of_last_shot = entry.at("tick_of_last_shot").get<int64_t>();
+            if (!tower_record_valid(record)) {
+                std::cerr << "JSON snapshot tower " << record.id << " is invalid\n";
+                return false;
+            }
+            game.towers.push_back(tower_from_record(record));
+        }
+    } catch (const json::exception &e) {
+        std::cerr << "Failed to parse JSON snapshot " << path << ": " << e.what() << "\n";
+        return false;
+    }
+    if (!game_state_valid(game, sim.load_listed)) return false;
+
+    sim.tick = tick;
+    std::swap(sim.game, game);
+    finish_snapshot_load(sim);
+    return true;
+}
@@ -0,0 +1,78 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include "sim.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+Snapshots of the game: the `GameState` (enemies including their handle tables, towers, projectiles, score,
+life and RNG state) plus the tick it was taken at. Everything else in `Simulation` is either configuration
+or derived from the game state and rebuilt on load (flow field, target candidates, grids).
+
+The binary format is a fixed header followed by the raw arrays of the stores back to back, in the order
+`snapshot_arrays` lists them and with the lengths the header gives. Saving encodes into one buffer and
+writes it with a single `write`, loading maps the file and copies every array out in one `memcpy`. Both
+sides use the host byte order, the header records it and loading rejects a file written with the other.
+
+The JSON format holds the same fields under the same names and is meant for looking at and editing states
+by hand, not for speed.
+*/
+struct SnapshotHeader {
+    static constexpr char expected_magic[8] = {'T', 'D', 'S', 'N', 'A', 'P', '\r', '\n'};
+    static constexpr uint32_t current_version = 2;
+    static constexpr uint32_t byte_order_mark = 0x01020304;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    // Of the whole snapshot including this header
+    uint64_t total_size;
+    int64_t tick;
+    int32_t score;
+    int32_t life;
+    uint32_t enemy_count;
+    // Lengths of `EnemyStore::slot_of_index` / `generation` and of `EnemyStore::free_indices`
+    uint32_t enemy_index_count;
+    uint32_t enemy_free_count;
+    uint32_t tower_count;
+    uint32_t projectile_count;
+    uint32_t reserved;
+};
+
+// The persistent part of a `Tower`, its target tracking is rebuilt on load.
+struct TowerRecord {
+    int32_t id;
+    int32_t level;
+    uint8_t is_active;
+    uint8_t type;
+    uint8_t targeting;
+    uint8_t padding[5];
+    float x;
+    float y;
+    float width;
+    float height;
+    int64_t tick_of_last_shot;
+};
+
+auto encode_snapshot(const Simulation &sim, std::vector<std::byte> &out) -> void;
+// Replaces the game state and tick of `sim`, returns false (leaving `sim` untouched) if the data is not a valid snapshot.
+auto decode_snapshot(const std::byte *data, size_t size, Simulation &sim) -> bool;
+
+// Writes an encoded snapshot to a temporary file and renames it over `path`, so a crash mid-save never
+// leaves a torn snapshot. Touches no simulation state and can run on another thread than the encode.
+auto write_snapshot_file(const std::string &path, const std::vector<std::byte> &data) -> bool;
+// `encode_snapshot` and `write_snapshot_file` in one go. `buffer` is only scratch space, passing the same
+// one every time keeps autosaves from allocating.
+auto save_snapshot(const Simulation &sim, const std::string &path, std::vector<std::byte> &buffer) -> bool;
+auto load_snapshot(Simulation &sim, const std::string &path) -> bool;
+
+// Hash of everything a snapshot stores, without encoding it. Equal states hash equal, replays compare it
+// every tick to notice the first tick on which they diverge.
+auto snapshot_hash(const Simulation &sim) -> uint64_t;
+
+auto export_snapshot_json(const Simulation &sim, const std::string &path) -> bool;
+auto import_snapshot_json(Simulation &sim, const std::string &path) -> bool;
@@ -0,0 +1,66 @@
+/* danielsinkin97@gmail.com */
+
+#include "spatial_grid.hpp"
+#include "enemy_store.hpp"
+
+#include <algorithm>
+
+SpatialGrid::SpatialGrid() : kernel(range_kernel(best_range_kernel_isa())) {
+    cols = static_cast<int>(std::ceil(2.0f * SimConstants::aspect_ratio / cell_size));
+    rows = static_cast<int>(std::ceil(2.0f / cell_size));
+    cell_start.assign(cols * rows + 1, 0);
+}
+
+auto SpatialGrid::cell_x(float x) const -> int {
+    int c = static_cast<int>(std::floor((x - min_x) / cell_size));
+    return std::clamp(c, 0, cols - 1);
+}
+
+auto SpatialGrid::cell_y(float y) const -> int {
+    int c = static_cast<int>(std::floor((y - min_y) / cell_size));
+    return std::clamp(c, 0, rows - 1);
+}
+
+auto SpatialGrid::rebuild(const EnemyStore &enemies) -> void {
+    int count = enemies.size();
+    std::fill(cell_start.begin(), cell_start.end(), 0);
+    slot_cell.resize(count);
+    slot_entry.resize(count);
+    max_half_width = 0.0f;
+    max_half_height = 0.0f;
+
+    for (int slot = 0; slot < count; ++slot) {
+        max_half_width = std::max(max_half_width, enemies.w[slot] * 0.5f);
+        max_half_height = std::max(max_half_height, enemies.h[slot] * 0.5f);
+        Position center = enemies.center(slot);
+        int cell = cell_y(center.y) * cols + cell_x(center.x);
+        slot_cell[slot] = cell;
+        cell_start[cell + 1] += 1;
+    }
+    for (size_t cell = 1; cell < cell_start.size(); ++cell) {
+        cell_start[cell] += cell_start[cell - 1];
+    }
+
+    entry_slots.resize(count);
+    entry_x.resize(count);
+    entry_y.resize(count);
+    entry_left.resize(count);
+    entry_right.resize(count);
+    entry_top.resize(count);
+    entry_bottom.resize(count);
+    // Forward fill through a cursor per cell, which keeps the entries of a cell in slot order.
+    cell_cursor.assign(cell_start.begin(), cell_start.end() - 1);
+    for (int slot = 0; slot < count; ++slot) {
+        int entry = cell_cursor[slot_cell[slot]]++;
+        Box box = enemies.box(slot);
+        Position center = box.get_center();
+        entry_slots[entry] = slot;
+        entry_x[entry] = center.x;
+        entry_y[entry] = center.y;
+        entry_left[entry] = box.position.x;
+        entry_right[entry] = box.position.x + box.width;
+        entry_top[entry] = box.position.y;
+        entry_bottom[entry] = box.position.y - box.height;
+        slot_entry[slot] = entry;
+    }
+}
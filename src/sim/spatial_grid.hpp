@@ -0,0 +1,130 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include "common.hpp"
+#include "range_kernel.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+struct EnemyStore;
+
+/*
+Uniform grid over the playfield holding enemy boxes by their center, rebuilt once per tick with a counting
+sort. Entries refer to `EnemyStore` slots, so the grid is only valid until the store is compacted.
+
+Entries of a cell are contiguous in the entry_* arrays, so a query only touches the cells overlapping the
+query shape and then streams over packed floats. Positions outside the playfield are clamped into the border
+cells, which keeps queries correct (just slower) for enemies that stray off screen. Vectors are only ever
+resized, so after warm-up a rebuild does not allocate.
+
+Rebuilds happen right after a compaction, so every slot is alive when inserted. Enemies that die during
+the tower pass are taken out with `remove`, which moves their entry out of reach of every query. Callers
+therefore never see dead enemies and don't need to check `EnemyStore::alive`.
+*/
+struct SpatialGrid {
+    float min_x = -SimConstants::aspect_ratio;
+    float min_y = -1.0f;
+    float cell_size = SimConstants::enemy_grid_cell_size;
+    int cols = 0;
+    int rows = 0;
+
+    // cell_start[c] .. cell_start[c + 1] is the entry range of cell c
+    std::vector<int> cell_start;
+    // Store slot of each entry
+    std::vector<int> entry_slots;
+    // Box center, used by the radius query
+    std::vector<float> entry_x;
+    std::vector<float> entry_y;
+    // Box edges, computed exactly like `collision_box_box` does so box queries agree with it bit for bit
+    std::vector<float> entry_left;
+    std::vector<float> entry_right;
+    std::vector<float> entry_top;
+    std::vector<float> entry_bottom;
+
+    // Largest half extents of any inserted box, box queries widen their cell range by these
+    float max_half_width = 0.0f;
+    float max_half_height = 0.0f;
+
+    // Cell and entry of each store slot (entry is -1 once removed)
+    std::vector<int> slot_cell;
+    std::vector<int> slot_entry;
+    std::vector<int> cell_cursor;
+
+    // Distance test used by radius queries, the widest variant the CPU supports unless overridden
+    RangeKernel kernel;
+
+    SpatialGrid();
+
+    auto cell_x(float x) const -> int;
+    auto cell_y(float y) const -> int;
+
+    // Inserts the boxes of all enemies in the store.
+    auto rebuild(const EnemyStore &enemies) -> void;
+
+    // Makes the enemy in `slot` invisible to all queries until the next rebuild.
+    auto remove(int slot) -> void {
+        int entry = slot_entry[slot];
+        if (entry == -1) return;
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        entry_x[entry] = inf;
+        entry_y[entry] = inf;
+        entry_left[entry] = inf;
+        entry_right[entry] = -inf;
+        entry_top[entry] = -inf;
+        entry_bottom[entry] = inf;
+        slot_entry[slot] = -1;
+    }
+
+    /*
+    Runs `kernel` over the entries of every cell the circle touches, a cell at most `range_kernel_block_size`
+    entries at a time. Calls f(slots, distances, block) per block: `distances[k]` belongs to `slots[k]` and
+    `block.mask` marks the entries whose center is strictly closer than `radius`.
+    */
+    template <typename F>
+    auto for_each_block_in_radius(Position center, float radius, F &&f) const -> void {
+        float distances[range_kernel_block_size];
+        int x0 = cell_x(center.x - radius);
+        int x1 = cell_x(center.x + radius);
+        int y0 = cell_y(center.y - radius);
+        int y1 = cell_y(center.y + radius);
+        for (int cy = y0; cy <= y1; ++cy) {
+            for (int cx = x0; cx <= x1; ++cx) {
+                int cell = cy * cols + cx;
+                int end = cell_start[cell + 1];
+                for (int k = cell_start[cell]; k < end; k += range_kernel_block_size) {
+                    int count = std::min(end - k, range_kernel_block_size);
+                    RangeBlock block = kernel(&entry_x[k], &entry_y[k], count, center, radius, distances);
+                    if (block.mask != 0) f(&entry_slots[k], distances, block);
+                }
+            }
+        }
+    }
+
+    // Calls f(slot) for every entry whose box overlaps `box` in the `collision_box_box` sense.
+    template <typename F>
+    auto for_each_overlapping(const Box &box, F &&f) const -> void {
+        float left = box.position.x;
+        float right = box.position.x + box.width;
+        float top = box.position.y;
+        float bottom = box.position.y - box.height;
+        // Centers of overlapping boxes lie within the query box grown by the largest half extent, the small
+        // pad keeps rounding at a cell border from dropping a candidate.
+        constexpr float pad = 1e-4f;
+        int x0 = cell_x(left - max_half_width - pad);
+        int x1 = cell_x(right + max_half_width + pad);
+        int y0 = cell_y(bottom - max_half_height - pad);
+        int y1 = cell_y(top + max_half_height + pad);
+        for (int cy = y0; cy <= y1; ++cy) {
+            for (int cx = x0; cx <= x1; ++cx) {
+                int cell = cy * cols + cx;
+                for (int k = cell_start[cell]; k < cell_start[cell + 1]; ++k) {
+                    bool xcoll = left < entry_right[k] && right > entry_left[k];
+                    bool ycoll = top > entry_bottom[k] && bottom < entry_top[k];
+                    if (xcoll && ycoll) f(entry_slots[k]);
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,43 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/*
+Bounded lock-free queue for exactly one producer thread and one consumer thread. The producer only writes
+`tail`, the consumer only writes `head`, and each publishes its index with a release store that the other
+side reads with an acquire load, so an item is fully written before the consumer can see it.
+
+One slot is kept empty to tell a full queue from an empty one, so it holds `Capacity - 1` items.
+*/
+template <typename T, size_t Capacity>
+struct SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    // Returns false (and drops the item) if the queue is full. Producer thread only.
+    auto push(const T &item) -> bool {
+        size_t tail_idx = tail.load(std::memory_order_relaxed);
+        size_t next = (tail_idx + 1) & (Capacity - 1);
+        if (next == head.load(std::memory_order_acquire)) return false;
+        items[tail_idx] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty. Consumer thread only.
+    auto pop(T &item) -> bool {
+        size_t head_idx = head.load(std::memory_order_relaxed);
+        if (head_idx == tail.load(std::memory_order_acquire)) return false;
+        item = items[head_idx];
+        head.store((head_idx + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+  private:
+    std::array<T, Capacity> items{};
+    // On separate cache lines so the two threads don't invalidate each other's index on every operation
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
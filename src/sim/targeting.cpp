@@ -0,0 +1,135 @@
+/* danielsinkin97@gmail.com */
+
+#include "targeting.hpp"
+
+#include <algorithm>
+
+auto targeting_policy_name(TargetingPolicy policy) -> const char * {
+    switch (policy) {
+    case TargetingPolicy::Closest:
+        return "closest";
+    case TargetingPolicy::First:
+        return "first";
+    case TargetingPolicy::Last:
+        return "last";
+    case TargetingPolicy::Strongest:
+        return "strongest";
+    case TargetingPolicy::Weakest:
+        return "weakest";
+    default:
+        panic("Unknown targeting policy");
+        return "";
+    }
+}
+
+auto next_targeting_policy(TargetingPolicy policy) -> TargetingPolicy {
+    int next = (static_cast<int>(policy) + 1) % static_cast<int>(TargetingPolicy::NumTargetingPolicy);
+    return static_cast<TargetingPolicy>(next);
+}
+
+auto BestTarget::consider(const EnemyStore &enemies, int slot, float distance) -> void {
+    float candidate_key;
+    switch (policy) {
+    case TargetingPolicy::Closest:
+        candidate_key = distance;
+        break;
+    case TargetingPolicy::First:
+        candidate_key = -enemies.progress[slot];
+        break;
+    case TargetingPolicy::Last:
+        candidate_key = enemies.progress[slot];
+        break;
+    case TargetingPolicy::Strongest:
+        candidate_key = -static_cast<float>(enemies.hp[slot]);
+        break;
+    case TargetingPolicy::Weakest:
+        candidate_key = static_cast<float>(enemies.hp[slot]);
+        break;
+    default:
+        panic("Unknown targeting policy");
+        return;
+    }
+    EnemyId candidate = enemies.id[slot];
+    if (!id || candidate_key < key || (candidate_key == key && candidate < *id)) {
+        id = candidate;
+        key = candidate_key;
+    }
+}
+
+auto TargetTracker::refresh(const std::vector<EnemyInRange> &found) -> void {
+    // When the lists have to grow, by half as much again: the count moves up and down a little between
+    // refreshes and would otherwise regrow them on every new high
+    if (candidates.capacity() < found.size()) {
+        size_t headroom = std::max<size_t>(found.size() + found.size() / 2, 16);
+        candidates.reserve(headroom);
+        candidate_member.reserve(headroom);
+        member_candidate.reserve(headroom);
+    }
+    candidates.clear();
+    for (const EnemyInRange &enemy : found) {
+        candidates.push_back(enemy.id);
+    }
+    candidate_member.assign(candidates.size(), -1);
+    in_range.clear();
+    // `found` is usually `in_range` itself, so only now that it has been read
+    in_range.reserve(candidates.capacity());
+    member_candidate.clear();
+    stale = false;
+}
+
+auto TargetTracker::enter(int candidate, EnemyId enemy_id, float distance) -> void {
+    candidate_member[candidate] = static_cast<int>(in_range.size());
+    in_range.push_back(EnemyInRange{enemy_id, distance});
+    member_candidate.push_back(candidate);
+}
+
+auto TargetTracker::exit(int candidate) -> void {
+    int member = candidate_member[candidate];
+    int last = static_cast<int>(in_range.size()) - 1;
+    if (member != last) {
+        in_range[member] = in_range[last];
+        member_candidate[member] = member_candidate[last];
+        candidate_member[member_candidate[member]] = member;
+    }
+    in_range.pop_back();
+    member_candidate.pop_back();
+    candidate_member[candidate] = -1;
+}
+
+auto TargetTracker::drop_candidate(int candidate) -> void {
+    if (candidate_member[candidate] != -1) exit(candidate);
+    int last = static_cast<int>(candidates.size()) - 1;
+    if (candidate != last) {
+        candidates[candidate] = candidates[last];
+        candidate_member[candidate] = candidate_member[last];
+        if (candidate_member[candidate] != -1) member_candidate[candidate_member[candidate]] = candidate;
+    }
+    candidates.pop_back();
+    candidate_member.pop_back();
+}
+
+auto TargetTracker::update(const EnemyStore &enemies, Position center, float range, TargetingPolicy policy) -> std::optional<EnemyId> {
+    BestTarget best(policy);
+    // Backwards, so dropping a candidate only moves one that was already checked
+    for (int candidate = static_cast<int>(candidates.size()) - 1; candidate >= 0; --candidate) {
+        int slot = enemies.slot_of(candidates[candidate]);
+        if (slot == -1 || !enemies.alive[slot]) {
+            drop_candidate(candidate);
+            continue;
+        }
+
+        float dist = distance(center, enemies.center(slot));
+        int member = candidate_member[candidate];
+        if (dist < range) {
+            if (member == -1) {
+                enter(candidate, candidates[candidate], dist);
+            } else {
+                in_range[member].distance = dist;
+            }
+            best.consider(enemies, slot, dist);
+        } else if (member != -1) {
+            exit(candidate);
+        }
+    }
+    return best.id;
+}
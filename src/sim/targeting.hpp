@@ -0,0 +1,71 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include "enemy_store.hpp"
+
+#include <optional>
+#include <vector>
+
+enum class TargetingPolicy {
+    Closest,
+    // Furthest along the path (or flow field), the one about to leak
+    First,
+    Last,
+    // Most and least current HP
+    Strongest,
+    Weakest,
+    NumTargetingPolicy
+};
+auto targeting_policy_name(TargetingPolicy policy) -> const char *;
+auto next_targeting_policy(TargetingPolicy policy) -> TargetingPolicy;
+
+struct EnemyInRange {
+    EnemyId id;
+    float distance;
+};
+
+// Keeps the best enemy seen so far under a policy, exact ties go to the lower id so every query order picks
+// the same one.
+struct BestTarget {
+    TargetingPolicy policy;
+    std::optional<EnemyId> id;
+    // Smaller is better, the policy decides what goes in here
+    float key = 0.0f;
+
+    explicit BestTarget(TargetingPolicy policy_) : policy(policy_) {}
+
+    auto consider(const EnemyStore &enemies, int slot, float distance) -> void;
+};
+
+/*
+Which enemies are in range of one tower, kept up to date with enter and exit events instead of a fresh
+range query every tick.
+
+`refresh` stores every enemy within range plus `SimConstants::target_skin` as a candidate. Enemies move at
+most `enemy_speed * dt` per tick, so until they moved `target_skin` in total no enemy outside the candidates
+can have come into range, and `update` only has to recheck the candidates: the ones crossing the range
+raise an enter or exit event that pushes them onto or swap-removes them from `in_range`. Dead candidates
+are dropped on the way. The simulation tracks how far enemies may have moved and asks for a refresh once
+that exceeds the skin or an enemy teleported.
+*/
+struct TargetTracker {
+    std::vector<EnemyId> candidates;
+    // Index into `in_range` of each candidate, -1 while it is out of range
+    std::vector<int> candidate_member;
+    // Enemies currently in range, in the order they entered
+    std::vector<EnemyInRange> in_range;
+    // Candidate index of each `in_range` entry
+    std::vector<int> member_candidate;
+    // Set for new towers, which have never been refreshed
+    bool stale = true;
+
+    // Replaces the candidates with the enemies in `found`, every enemy in range enters again at the next update.
+    auto refresh(const std::vector<EnemyInRange> &found) -> void;
+    // Rechecks every candidate against `range` around `center` and returns the best one in range under `policy`.
+    auto update(const EnemyStore &enemies, Position center, float range, TargetingPolicy policy) -> std::optional<EnemyId>;
+
+  private:
+    auto enter(int candidate, EnemyId enemy_id, float distance) -> void;
+    auto exit(int candidate) -> void;
+    auto drop_candidate(int candidate) -> void;
+};
@@ -0,0 +1,72 @@
+/* danielsinkin97@gmail.com */
+
+#include "thread_pool.hpp"
+#include "common.hpp"
+#include "profiler.hpp"
+
+ThreadPool::ThreadPool(int thread_count) {
+    if (thread_count < 1) panic("ThreadPool needs at least one thread");
+    for (int i = 1; i < thread_count; ++i) {
+        workers.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+auto ThreadPool::run_tasks() -> void {
+    for (int task = next_task.fetch_add(1); task < current_task_count; task = next_task.fetch_add(1)) {
+        (*current_task)(task);
+    }
+}
+
+auto ThreadPool::worker_loop() -> void {
+    profiler_set_thread_name("pool worker");
+    long long seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [&]() { return stopping || generation != seen_generation; });
+            if (stopping) return;
+            seen_generation = generation;
+        }
+        run_tasks();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy_workers -= 1;
+        }
+        work_done.notify_one();
+    }
+}
+
+auto ThreadPool::parallel_for(int task_count, const std::function<void(int)> &task) -> void {
+    if (workers.empty() || task_count <= 1) {
+        for (int i = 0; i < task_count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current_task = &task;
+        current_task_count = task_count;
+        next_task.store(0);
+        busy_workers = static_cast<int>(workers.size());
+        generation += 1;
+    }
+    work_ready.notify_all();
+    run_tasks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [&]() { return busy_workers == 0; });
+    current_task = nullptr;
+}
@@ -0,0 +1,48 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+Fork-join pool for the parallel phases of a tick. `parallel_for` hands out task indices to the workers and
+the calling thread and returns once every task ran, so callers never see a half finished phase.
+
+Which thread runs which task is not deterministic, callers that need a deterministic result write to
+per-task state and combine it in task order afterwards.
+*/
+struct ThreadPool {
+    // `thread_count` includes the calling thread, so 1 means no extra threads at all.
+    explicit ThreadPool(int thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    auto operator=(const ThreadPool &) -> ThreadPool & = delete;
+
+    auto thread_count() const -> int { return static_cast<int>(workers.size()) + 1; }
+
+    // Runs task(i) for every i in [0, task_count) and blocks until all of them returned.
+    auto parallel_for(int task_count, const std::function<void(int)> &task) -> void;
+
+  private:
+    auto worker_loop() -> void;
+    auto run_tasks() -> void;
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    // Bumped for every `parallel_for`, workers wait for it to change
+    long long generation = 0;
+    int busy_workers = 0;
+    bool stopping = false;
+
+    const std::function<void(int)> *current_task = nullptr;
+    int current_task_count = 0;
+    std::atomic<int> next_task{0};
+};